@@ -45,6 +45,7 @@ extern "C" {
 #define APPVAR_MAX_BEFORE_COMPRESSION_SIZE (65505*4)
 #define APPVAR_MAX_COMMENT_SIZE 42
 #define APPVAR_MAX_NAME_SIZE 8
+#define APPVAR_MAX_BLOCK_SIZE 32768
 
 #define APPVAR_TYPE_FLAG 21
 #define APPVAR_ARCHIVE_FLAG 128
@@ -94,6 +95,13 @@ struct appvar
     char comment[APPVAR_MAX_COMMENT_SIZE + 1];
     appvar_source_t source;
     compress_mode_t compress;
+    compress_mode_t compression;
+    uint32_t compress_min_gain;
+    uint32_t compress_tolerance;
+    struct compress_stats compress_stats;
+    uint32_t decompress_delta;
+    uint32_t block_size;
+    uint32_t nr_blocks;
 };
 
 int appvar_write(struct appvar *a, const char *path);
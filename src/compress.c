@@ -30,6 +30,8 @@
 
 #include "compress.h"
 #include "memory.h"
+#include "file.h"
+#include "report.h"
 #include "log.h"
 
 #include "deps/zx/zx7/zx7.h"
@@ -38,18 +40,286 @@
 
 #include <string.h>
 
-static uint8_t *compress_zx7(void *data, size_t *size)
+static bool compress_verify;
+
+struct decompress
+{
+    const uint8_t *data;
+    size_t size;
+    size_t index;
+    uint8_t *out;
+    size_t out_size;
+    size_t out_index;
+    uint8_t bit_mask;
+    uint8_t bit_value;
+    uint8_t last_byte;
+    bool backtrack;
+    bool error;
+};
+
+static uint8_t decompress_byte(struct decompress *d)
+{
+    if (d->index >= d->size)
+    {
+        d->error = true;
+        return 0;
+    }
+
+    d->last_byte = d->data[d->index++];
+
+    return d->last_byte;
+}
+
+static int decompress_bit(struct decompress *d)
+{
+    /* zx0 reuses the low bit of an offset byte */
+    if (d->backtrack)
+    {
+        d->backtrack = false;
+        return d->last_byte & 1;
+    }
+
+    d->bit_mask >>= 1;
+    if (d->bit_mask == 0)
+    {
+        d->bit_mask = 128;
+        d->bit_value = decompress_byte(d);
+    }
+
+    return d->bit_value & d->bit_mask ? 1 : 0;
+}
+
+static void decompress_literal(struct decompress *d)
+{
+    uint8_t byte = decompress_byte(d);
+
+    if (d->out_index >= d->out_size)
+    {
+        d->error = true;
+        return;
+    }
+
+    d->out[d->out_index++] = byte;
+}
+
+static void decompress_match(struct decompress *d, uint32_t offset, uint32_t length)
+{
+    if (offset == 0 || offset > d->out_index || length > d->out_size - d->out_index)
+    {
+        d->error = true;
+        return;
+    }
+
+    for (uint32_t i = 0; i < length; ++i, ++d->out_index)
+    {
+        d->out[d->out_index] = d->out[d->out_index - offset];
+    }
+}
+
+static uint32_t decompress_zx0_gamma(struct decompress *d, int inverted)
+{
+    uint32_t value = 1;
+
+    while (!d->error && !decompress_bit(d))
+    {
+        if (value > 0xffff)
+        {
+            d->error = true;
+            break;
+        }
+
+        value = value << 1 | (decompress_bit(d) ^ inverted);
+    }
+
+    return value;
+}
+
+static void decompress_zx0(struct decompress *d)
+{
+    uint32_t last_offset = 1;
+    uint32_t length;
+
+    for (;;)
+    {
+        /* literals, then a match from the last or a new offset */
+        length = decompress_zx0_gamma(d, 0);
+        for (uint32_t i = 0; i < length && !d->error; ++i)
+        {
+            decompress_literal(d);
+        }
+
+        if (d->error)
+        {
+            return;
+        }
+
+        if (!decompress_bit(d))
+        {
+            length = decompress_zx0_gamma(d, 0);
+            decompress_match(d, last_offset, length);
+
+            if (d->error || !decompress_bit(d))
+            {
+                continue;
+            }
+        }
+
+        do
+        {
+            last_offset = decompress_zx0_gamma(d, 1);
+            if (last_offset == 256 || d->error)
+            {
+                return;
+            }
+
+            last_offset = last_offset * 128 - (decompress_byte(d) >> 1);
+            d->backtrack = true;
+
+            length = decompress_zx0_gamma(d, 0) + 1;
+            decompress_match(d, last_offset, length);
+        } while (!d->error && decompress_bit(d));
+    }
+}
+
+static void decompress_zx7(struct decompress *d)
+{
+    decompress_literal(d);
+
+    while (!d->error)
+    {
+        uint32_t length;
+        uint32_t offset;
+        uint32_t zeros = 0;
+
+        if (!decompress_bit(d))
+        {
+            decompress_literal(d);
+            continue;
+        }
+
+        while (!d->error && !decompress_bit(d))
+        {
+            zeros++;
+        }
+
+        /* sixteen zero bits mark the end of the stream */
+        if (zeros > 15)
+        {
+            return;
+        }
+
+        length = 1;
+        while (zeros--)
+        {
+            length = length << 1 | decompress_bit(d);
+        }
+
+        offset = decompress_byte(d);
+        if (offset >= 128)
+        {
+            uint32_t high = 0;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                high = high << 1 | decompress_bit(d);
+            }
+
+            offset = ((offset & 127) | high << 7) + 128;
+        }
+
+        decompress_match(d, offset + 1, length + 1);
+    }
+}
+
+static int decompress_stream(const uint8_t *data, size_t size, uint8_t *out, size_t out_size, void (*decode)(struct decompress *))
+{
+    struct decompress d =
+    {
+        .data = data,
+        .size = size,
+        .out = out,
+        .out_size = out_size,
+    };
+
+    decode(&d);
+
+    return d.error || d.out_index != out_size ? -1 : 0;
+}
+
+static int decompress_zx7_array(const uint8_t *data, size_t size, uint8_t *out, size_t out_size)
+{
+    return decompress_stream(data, size, out, out_size, decompress_zx7);
+}
+
+static int decompress_zx0_array(const uint8_t *data, size_t size, uint8_t *out, size_t out_size)
+{
+    return decompress_stream(data, size, out, out_size, decompress_zx0);
+}
+
+static int decompress_lz4_array(const uint8_t *data, size_t size, uint8_t *out, size_t out_size)
+{
+    int new_size = LZ4_decompress_safe((const char*)data, (char*)out, size, out_size);
+
+    return new_size < 0 || (size_t)new_size != out_size ? -1 : 0;
+}
+
+int decompress_array(const uint8_t *data, size_t size, uint8_t *out, size_t out_size, compress_mode_t mode)
+{
+    const struct compress_codec *codec = compress_codec(mode);
+
+    if (codec == NULL)
+    {
+        return -1;
+    }
+
+    return codec->decompress(data, size, out, out_size);
+}
+
+void compress_set_verify(bool verify)
+{
+    compress_verify = verify;
+}
+
+/* decompresses the result and compares it with the input */
+static int compress_check(const uint8_t *data, size_t size, const uint8_t *compressed_data, size_t compressed_size, compress_mode_t mode)
+{
+    uint8_t *out;
+    int ret;
+
+    out = memory_arena_alloc(size ? size : 1);
+    if (out == NULL)
+    {
+        return -1;
+    }
+
+    ret = decompress_array(compressed_data, compressed_size, out, size, mode);
+    if (ret == 0 && memcmp(out, data, size))
+    {
+        ret = -1;
+    }
+
+    memory_arena_free(out);
+
+    if (ret)
+    {
+        LOG_ERROR("Compressed data failed verification (%s).\n", compress_mode_name(mode));
+    }
+
+    return ret;
+}
+
+static uint8_t *compress_zx7(void *data, size_t *size, uint32_t *delta)
 {
     uint8_t *compressed_data;
     int new_size;
-    long delta;
+    long new_delta;
 
     if (size == NULL || data == NULL)
     {
         return NULL;
     }
 
-    compressed_data = zx7_compress(data, *size, 0, &new_size, &delta);
+    compressed_data = zx7_compress(data, *size, 0, &new_size, &new_delta);
     if (compressed_data == NULL)
     {
         LOG_ERROR("Out of memory.\n");
@@ -59,6 +329,7 @@ static uint8_t *compress_zx7(void *data, size_t *size)
     LOG_DEBUG("Compressed size: %u -> %u (zx7)\n", *size, new_size);
 
     *size = new_size;
+    *delta = new_delta;
 
     return compressed_data;
 }
@@ -68,12 +339,12 @@ static void compress_zx0_progress(int amount)
     LOG_INFO(" - Compressing Data (%d%%)\n", amount * 10);
 }
 
-static uint8_t *compress_zx0(void *data, size_t *size)
+static uint8_t *compress_zx0(void *data, size_t *size, uint32_t *delta)
 {
     uint8_t *compressed_data;
     int orig_size;
     int new_size;
-    int delta;
+    int new_delta;
 
     if (size == NULL || data == NULL)
     {
@@ -82,7 +353,7 @@ static uint8_t *compress_zx0(void *data, size_t *size)
 
     orig_size = *size;
 
-    compressed_data = zx0_compress(data, orig_size, 0, 0, 1, &new_size, &delta, orig_size > 16384 ? compress_zx0_progress : NULL);
+    compressed_data = zx0_compress(data, orig_size, 0, 0, 1, &new_size, &new_delta, orig_size > 16384 ? compress_zx0_progress : NULL);
     if (compressed_data == NULL)
     {
         LOG_ERROR("Out of memory.\n");
@@ -92,14 +363,16 @@ static uint8_t *compress_zx0(void *data, size_t *size)
     LOG_DEBUG("Compressed size: %u -> %u (zx0)\n", orig_size, new_size);
 
     *size = new_size;
+    *delta = new_delta;
 
     return compressed_data;
 }
 
-static uint8_t *compress_lz4(void *data, size_t *size)
+static uint8_t *compress_lz4(void *data, size_t *size, uint32_t *delta)
 {
     const char *input = data;
     uint8_t *compressed_data;
+    uint8_t *bound_data;
     int orig_size = *size;
     int new_size;
 
@@ -110,21 +383,36 @@ static uint8_t *compress_lz4(void *data, size_t *size)
 
     orig_size = *size;
     new_size = LZ4_compressBound(orig_size);
-    compressed_data = malloc(new_size);
-    if (compressed_data == NULL)
+    *delta = 0;
+
+    /* compress into task memory, then keep only the used part */
+    bound_data = memory_arena_alloc(new_size);
+    if (bound_data == NULL)
     {
-        LOG_ERROR("Out of memory.\n");
         return NULL;
     }
 
-    new_size = LZ4_compress_default(input, (char*)compressed_data, orig_size, new_size);
+    new_size = LZ4_compress_default(input, (char*)bound_data, orig_size, new_size);
     if (!new_size)
     {
-        free(compressed_data);
+        memory_arena_free(bound_data);
         LOG_ERROR("LZ4 compression failed.\n");
         return NULL;
     }
 
+    compressed_data = memory_alloc(new_size);
+    if (compressed_data != NULL)
+    {
+        memcpy(compressed_data, bound_data, new_size);
+    }
+
+    memory_arena_free(bound_data);
+
+    if (compressed_data == NULL)
+    {
+        return NULL;
+    }
+
     LOG_DEBUG("Compressed size: %u -> %u (lz4)\n", orig_size, new_size);
 
     *size = new_size;
@@ -132,20 +420,463 @@ static uint8_t *compress_lz4(void *data, size_t *size)
     return compressed_data;
 }
 
-uint8_t *compress_array(uint8_t *data, size_t *size, compress_mode_t mode)
+/* zx7 and zx0 fall back to literals, one flag bit per byte */
+static size_t compress_zx_bound(size_t size)
+{
+    return size + size / 8 + 16;
+}
+
+static size_t compress_lz4_bound(size_t size)
+{
+    return LZ4_compressBound(size);
+}
+
+/* fastest decompression first, so best mode size ties keep the faster codec */
+static const struct compress_codec compress_codecs[] =
+{
+    {
+        .mode = COMPRESS_LZ4,
+        .name = "lz4",
+        .window = 65535,
+        .compress = compress_lz4,
+        .bound = compress_lz4_bound,
+        .decompress = decompress_lz4_array,
+        .in_place = false,
+        .decompress_function = NULL,
+    },
+    {
+        .mode = COMPRESS_ZX7,
+        .name = "zx7",
+        .window = 2176,
+        .compress = compress_zx7,
+        .bound = compress_zx_bound,
+        .decompress = decompress_zx7_array,
+        .in_place = true,
+        .decompress_function = "zx7_Decompress",
+    },
+    {
+        .mode = COMPRESS_ZX0,
+        .name = "zx0",
+        .window = 32640,
+        .compress = compress_zx0,
+        .bound = compress_zx_bound,
+        .decompress = decompress_zx0_array,
+        .in_place = true,
+        .decompress_function = "zx0_Decompress",
+    },
+};
+
+#define COMPRESS_NR_CODECS (sizeof compress_codecs / sizeof compress_codecs[0])
+
+const struct compress_codec *compress_codec(compress_mode_t mode)
+{
+    for (size_t i = 0; i < COMPRESS_NR_CODECS; ++i)
+    {
+        if (compress_codecs[i].mode == mode)
+        {
+            return &compress_codecs[i];
+        }
+    }
+
+    return NULL;
+}
+
+const struct compress_codec *compress_codec_find(const char *name)
+{
+    for (size_t i = 0; i < COMPRESS_NR_CODECS; ++i)
+    {
+        if (strcmp(compress_codecs[i].name, name) == 0)
+        {
+            return &compress_codecs[i];
+        }
+    }
+
+    return NULL;
+}
+
+static uint8_t *compress_mode(uint8_t *data, size_t *size, compress_mode_t mode, struct compress_stats *stats)
+{
+    const struct compress_codec *codec = compress_codec(mode);
+    uint8_t *compressed_data;
+    uint32_t delta = 0;
+
+    if (codec == NULL)
+    {
+        return NULL;
+    }
+
+    compressed_data = codec->compress(data, size, &delta);
+    if (compressed_data != NULL)
+    {
+        stats->sizes[mode] += *size;
+        stats->delta = delta;
+    }
+
+    return compressed_data;
+}
+
+/* keeps the fastest codec within tolerance percent of the smallest result */
+static uint8_t *compress_best(uint8_t *data, size_t *size, compress_mode_t *mode, uint32_t tolerance, struct compress_stats *stats)
+{
+    uint8_t *results[COMPRESS_NR_CODECS] = { NULL };
+    size_t sizes[COMPRESS_NR_CODECS];
+    uint32_t deltas[COMPRESS_NR_CODECS];
+    size_t smallest = 0;
+    size_t best;
+
+    for (size_t i = 0; i < COMPRESS_NR_CODECS; ++i)
+    {
+        sizes[i] = *size;
+
+        results[i] = compress_mode(data, &sizes[i], compress_codecs[i].mode, stats);
+        if (results[i] == NULL)
+        {
+            goto error;
+        }
+
+        deltas[i] = stats->delta;
+
+        if (sizes[i] < sizes[smallest])
+        {
+            smallest = i;
+        }
+    }
+
+    /* codecs are ordered by decompression speed, so the first in range wins */
+    for (best = 0; best < smallest; ++best)
+    {
+        if ((uint64_t)sizes[best] * 100 <= (uint64_t)sizes[smallest] * (100 + tolerance))
+        {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < COMPRESS_NR_CODECS; ++i)
+    {
+        if (i != best)
+        {
+            free(results[i]);
+        }
+    }
+
+    *mode = compress_codecs[best].mode;
+
+    LOG_DEBUG("Best compression: %s\n", compress_mode_name(*mode));
+
+    *size = sizes[best];
+    stats->delta = deltas[best];
+
+    return results[best];
+
+error:
+    for (size_t i = 0; i < COMPRESS_NR_CODECS; ++i)
+    {
+        free(results[i]);
+    }
+
+    return NULL;
+}
+
+const char *compress_mode_name(compress_mode_t mode)
 {
-    switch (mode)
+    const struct compress_codec *codec = compress_codec(mode);
+
+    if (codec != NULL)
     {
-        case COMPRESS_ZX7:
-            return compress_zx7(data, size);
+        return codec->name;
+    }
 
-        case COMPRESS_ZX0:
-            return compress_zx0(data, size);
+    return mode == COMPRESS_BEST ? "best" : "none";
+}
+
+#define COMPRESS_ESTIMATE_HASH_BITS 12
+#define COMPRESS_ESTIMATE_MAX_LENGTH 255
 
-        case COMPRESS_LZ4:
-            return compress_lz4(data, size);
+static uint32_t compress_estimate_gamma(uint32_t value)
+{
+    uint32_t bits = 1;
 
-        default:
-            return NULL;
+    while (value >>= 1)
+    {
+        bits += 2;
     }
+
+    return bits;
+}
+
+static size_t compress_estimate_window(compress_mode_t mode)
+{
+    const struct compress_codec *codec = compress_codec(mode);
+    size_t window = 0;
+
+    if (codec != NULL)
+    {
+        return codec->window;
+    }
+
+    /* best mode can keep any codec */
+    for (size_t i = 0; i < COMPRESS_NR_CODECS; ++i)
+    {
+        if (compress_codecs[i].window > window)
+        {
+            window = compress_codecs[i].window;
+        }
+    }
+
+    return window;
+}
+
+/*
+ * none of the codecs entropy code their literals, so a greedy match probe
+ * with zx0 style costs predicts the compressed size better than entropy
+ */
+static uint32_t compress_estimate(const uint8_t *data, size_t size, compress_mode_t mode)
+{
+    size_t window = compress_estimate_window(mode);
+    uint32_t *table;
+    uint64_t bits = 18;
+    size_t i = 0;
+
+    table = memory_arena_alloc(sizeof(uint32_t) << COMPRESS_ESTIMATE_HASH_BITS);
+    if (table == NULL)
+    {
+        return size;
+    }
+
+    /* positions are stored plus one so zero is empty */
+    memset(table, 0, sizeof(uint32_t) << COMPRESS_ESTIMATE_HASH_BITS);
+
+    while (i < size)
+    {
+        uint32_t length = 0;
+        uint32_t offset = 0;
+
+        if (i + 2 < size)
+        {
+            uint32_t hash = (data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u;
+            uint32_t *entry = &table[hash >> (32 - COMPRESS_ESTIMATE_HASH_BITS)];
+
+            if (*entry != 0 && i - (*entry - 1) <= window)
+            {
+                const uint8_t *match = &data[*entry - 1];
+
+                while (i + length < size &&
+                       length < COMPRESS_ESTIMATE_MAX_LENGTH &&
+                       match[length] == data[i + length])
+                {
+                    length++;
+                }
+
+                offset = i - (*entry - 1);
+            }
+
+            *entry = i + 1;
+        }
+
+        if (length >= 3)
+        {
+            bits += 1 + compress_estimate_gamma(length - 1) + 7 + compress_estimate_gamma((offset - 1) / 128 + 1);
+            i += length;
+        }
+        else
+        {
+            bits += 9;
+            i++;
+        }
+    }
+
+    memory_arena_free(table);
+
+    return (bits + 7) / 8;
+}
+
+/* true when the size is not at least min_gain percent smaller */
+static bool compress_under_gain(size_t new_size, size_t size, uint32_t min_gain)
+{
+    return (uint64_t)new_size * 100 > (uint64_t)size * (100 - min_gain);
+}
+
+/* keeps a copy of the input when compression is not worth it */
+static uint8_t *compress_store(uint8_t *data, size_t size, compress_mode_t *mode, struct compress_stats *stats)
+{
+    uint8_t *stored_data;
+
+    stored_data = memory_alloc(size ? size : 1);
+    if (stored_data == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(stored_data, data, size);
+
+    LOG_DEBUG("Stored uncompressed: %u bytes\n", (unsigned int)size);
+
+    *mode = COMPRESS_NONE;
+    stats->delta = 0;
+
+    return stored_data;
+}
+
+bool compress_mode_in_place(compress_mode_t mode)
+{
+    const struct compress_codec *codec = compress_codec(mode);
+
+    return codec != NULL && codec->in_place;
+}
+
+uint8_t *compress_array(uint8_t *data, size_t *size, compress_mode_t *mode, uint32_t min_gain, uint32_t tolerance, struct compress_stats *stats)
+{
+    double start = report_clock();
+    size_t orig_size = *size;
+    uint8_t *compressed_data;
+
+    if (min_gain != 0)
+    {
+        stats->estimate = compress_estimate(data, orig_size, *mode);
+
+        if (compress_under_gain(stats->estimate, orig_size, min_gain))
+        {
+            compressed_data = compress_store(data, orig_size, mode, stats);
+            stats->time += report_clock() - start;
+            return compressed_data;
+        }
+    }
+
+    if (*mode == COMPRESS_BEST)
+    {
+        compressed_data = compress_best(data, size, mode, tolerance, stats);
+    }
+    else
+    {
+        compressed_data = compress_mode(data, size, *mode, stats);
+    }
+
+    /* the probe can be optimistic, so check the real result as well */
+    if (min_gain != 0 && compressed_data != NULL &&
+        compress_under_gain(*size, orig_size, min_gain))
+    {
+        free(compressed_data);
+        *size = orig_size;
+        compressed_data = compress_store(data, orig_size, mode, stats);
+    }
+
+    stats->time += report_clock() - start;
+
+    if (compress_verify && compressed_data != NULL && *mode != COMPRESS_NONE &&
+        compress_check(data, orig_size, compressed_data, *size, *mode))
+    {
+        free(compressed_data);
+        return NULL;
+    }
+
+    return compressed_data;
+}
+
+/* decodes repeatedly for at least this long to get a stable rate */
+#define COMPRESS_BENCH_MIN_TIME 0.1
+
+static double compress_bench_rate(size_t size, double time)
+{
+    return time > 0 ? size / time / (1024 * 1024) : 0;
+}
+
+static int compress_bench_codec(const struct compress_codec *codec, const uint8_t *data, size_t size)
+{
+    uint8_t *input = NULL;
+    uint8_t *compressed_data = NULL;
+    uint8_t *output = NULL;
+    size_t new_size = size;
+    uint32_t delta = 0;
+    uint32_t runs = 0;
+    double compress_time;
+    double decompress_time;
+    double start;
+
+    /* compressors take a writable buffer */
+    input = memory_alloc(size);
+    output = memory_alloc(size);
+    if (input == NULL || output == NULL)
+    {
+        goto error;
+    }
+
+    memcpy(input, data, size);
+
+    start = report_clock();
+    compressed_data = codec->compress(input, &new_size, &delta);
+    compress_time = report_clock() - start;
+    if (compressed_data == NULL)
+    {
+        goto error;
+    }
+
+    start = report_clock();
+    do
+    {
+        if (codec->decompress(compressed_data, new_size, output, size) ||
+            memcmp(output, data, size))
+        {
+            LOG_ERROR("Compressed data failed verification (%s).\n", codec->name);
+            goto error;
+        }
+
+        runs++;
+        decompress_time = report_clock() - start;
+    } while (decompress_time < COMPRESS_BENCH_MIN_TIME);
+
+    LOG_PRINT("%-8s %10u %10u %7.2f%% %8u %10.2f %10.2f\n",
+        codec->name,
+        (unsigned int)new_size,
+        (unsigned int)codec->bound(size),
+        new_size * 100.0 / size,
+        codec->in_place ? delta : 0,
+        compress_bench_rate(size, compress_time),
+        compress_bench_rate(size * runs, decompress_time));
+
+    free(compressed_data);
+    free(output);
+    free(input);
+
+    return 0;
+
+error:
+    free(compressed_data);
+    free(output);
+    free(input);
+    return -1;
+}
+
+int compress_bench(const char *path)
+{
+    struct file_map map;
+    int ret = 0;
+
+    if (file_map_open(&map, path))
+    {
+        LOG_ERROR("Could not open \'%s\'.\n", path);
+        return -1;
+    }
+
+    if (map.size == 0)
+    {
+        LOG_ERROR("Nothing to compress in \'%s\'.\n", path);
+        file_map_close(&map);
+        return -1;
+    }
+
+    LOG_PRINT("Benchmarking \'%s\' (%u bytes)\n", path, (unsigned int)map.size);
+    LOG_PRINT("%-8s %10s %10s %8s %8s %10s %10s\n",
+        "codec", "size", "bound", "ratio", "delta", "comp MB/s", "host MB/s");
+
+    for (size_t i = 0; i < COMPRESS_NR_CODECS; ++i)
+    {
+        if (compress_bench_codec(&compress_codecs[i], map.data, map.size))
+        {
+            ret = -1;
+        }
+    }
+
+    file_map_close(&map);
+
+    return ret;
 }
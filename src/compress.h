@@ -31,22 +31,80 @@
 #ifndef COMPRESS_H
 #define COMPRESS_H
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 
+#define COMPRESS_MAX_MIN_GAIN 99
+#define COMPRESS_MAX_TOLERANCE 100
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* exported as <name>_compression, new codecs go before COMPRESS_BEST */
 typedef enum
 {
     COMPRESS_NONE,
     COMPRESS_ZX7,
     COMPRESS_ZX0,
     COMPRESS_LZ4,
+    COMPRESS_BEST,
 } compress_mode_t;
 
-uint8_t *compress_array(uint8_t *data, size_t *size, compress_mode_t mode);
+struct compress_stats
+{
+    /* compressed size from each codec that was tried */
+    uint32_t sizes[COMPRESS_BEST];
+    double time;
+
+    /* in-place decompression gap of the kept zx7 or zx0 result */
+    uint32_t delta;
+
+    /* size predicted by the match probe when a minimum gain is set */
+    uint32_t estimate;
+};
+
+/* a codec compress_array() can use, described for the outputs */
+struct compress_codec
+{
+    compress_mode_t mode;
+    const char *name;
+
+    /* furthest match offset */
+    size_t window;
+
+    /* replaces size with the compressed size and sets the in-place gap */
+    uint8_t *(*compress)(void *data, size_t *size, uint32_t *delta);
+
+    /* largest compressed size for an input size */
+    size_t (*bound)(size_t size);
+
+    /* returns 0 when exactly out_size bytes were decoded */
+    int (*decompress)(const uint8_t *data, size_t size, uint8_t *out, size_t out_size);
+
+    /* can decompress over its own input given the reported gap */
+    bool in_place;
+
+    /* toolchain routine taking (dst, src), or NULL if there is none */
+    const char *decompress_function;
+};
+
+const struct compress_codec *compress_codec(compress_mode_t mode);
+
+const struct compress_codec *compress_codec_find(const char *name);
+
+const char *compress_mode_name(compress_mode_t mode);
+
+bool compress_mode_in_place(compress_mode_t mode);
+
+void compress_set_verify(bool verify);
+
+int decompress_array(const uint8_t *data, size_t size, uint8_t *out, size_t out_size, compress_mode_t mode);
+
+uint8_t *compress_array(uint8_t *data, size_t *size, compress_mode_t *mode, uint32_t min_gain, uint32_t tolerance, struct compress_stats *stats);
+
+int compress_bench(const char *path);
 
 #ifdef __cplusplus
 }
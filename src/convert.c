@@ -36,14 +36,20 @@
 #include "log.h"
 #include "image.h"
 #include "thread.h"
+#include "cpu.h"
+#include "report.h"
 
 #include <string.h>
 #include <glob.h>
 
+#define CONVERT_PREFETCH_AHEAD 8
+
 struct conv
 {
     struct convert *convert;
     struct image *image;
+    struct tileset *tileset;
+    uint32_t band;
 };
 
 struct convert *convert_alloc(void)
@@ -56,7 +62,14 @@ struct convert *convert_alloc(void)
 
     convert->images = NULL;
     convert->nr_images = 0;
+    convert->convs = NULL;
+    convert->sheets = NULL;
+    convert->nr_sheets = 0;
+    convert->done = NULL;
+    convert->nr_output_refs = 0;
     convert->compress = COMPRESS_NONE;
+    convert->compress_min_gain = 0;
+    convert->compress_tolerance = 0;
     convert->palette = NULL;
     convert->palette_offset = 0;
     convert->style = CONVERT_STYLE_PALETTE;
@@ -81,6 +94,9 @@ struct convert *convert_alloc(void)
     convert->tile_rotate = 0;
     convert->tile_flip_x = false;
     convert->tile_flip_y = false;
+    convert->tile_deduplicate = TILESET_DEDUPLICATE_NONE;
+    convert->tile_quantize_once = false;
+    convert->tilemap = false;
     convert->p_table = true;
 
     return convert;
@@ -117,6 +133,36 @@ static int convert_add_image(struct convert *convert, const char *path)
     return 0;
 }
 
+struct sheet *convert_add_sheet(struct convert *convert, const char *path)
+{
+    struct sheet *sheet;
+
+    if (convert == NULL || path == NULL)
+    {
+        return NULL;
+    }
+
+    convert->sheets = memory_realloc_array(convert->sheets, convert->nr_sheets + 1, sizeof(struct sheet));
+    if (convert->sheets == NULL)
+    {
+        return NULL;
+    }
+
+    sheet = &convert->sheets[convert->nr_sheets];
+    convert->nr_sheets++;
+
+    image_init(&sheet->image, path);
+    sheet->sprites = NULL;
+    sheet->nr_sprites = 0;
+    sheet->sprite_width = 0;
+    sheet->sprite_height = 0;
+    atomic_init(&sheet->nr_pending, 0);
+
+    LOG_DEBUG("Adding convert sheet: %s\n", sheet->image.path);
+
+    return sheet;
+}
+
 static int convert_add_tileset(struct convert *convert, const char *path)
 {
     struct tileset *tileset;
@@ -139,6 +185,22 @@ static int convert_add_tileset(struct convert *convert, const char *path)
 
     tileset->tiles = NULL;
     tileset->nr_tiles = 0;
+    tileset->deduplicate = TILESET_DEDUPLICATE_NONE;
+    tileset->tile_sources = NULL;
+    tileset->tile_transforms = NULL;
+    tileset->quantize_once = false;
+    tileset->tilemap = false;
+    tileset->indexed = false;
+    tileset->tile_hashes = NULL;
+    tileset->tile_map = NULL;
+    tileset->tile_map_size = 0;
+    tileset->tile_map_entry_size = 0;
+    tileset->nr_tile_map_entries = 0;
+    tileset->tile_map_width = 0;
+    tileset->tile_map_height = 0;
+    tileset->converted = false;
+    tileset->stored = false;
+    tileset->nr_pending_outputs = 0;
 
     image = &tileset->image;
     image->path = strings_dup(path);
@@ -146,7 +208,16 @@ static int convert_add_tileset(struct convert *convert, const char *path)
     image->data = NULL;
     image->width = 0;
     image->height = 0;
+    image->map.handle = NULL;
+    image->sheet = NULL;
+    image->stride = 0;
     image->compressed = false;
+    image->compression = COMPRESS_NONE;
+    image->stored = false;
+    image->decompress_delta = 0;
+    image->converted_size = 0;
+    image->quantize_time = 0;
+    memset(&image->compress_stats, 0, sizeof image->compress_stats);
     image->rlet = false;
     image->rotate = 0;
     image->flip_x = false;
@@ -256,9 +327,20 @@ void convert_free(struct convert *convert)
     free(convert->tilesets);
     convert->nr_tilesets = 0;
 
+    for (uint32_t i = 0; i < convert->nr_sheets; ++i)
+    {
+        sheet_free(&convert->sheets[i]);
+    }
+    free(convert->sheets);
+    convert->sheets = NULL;
+    convert->nr_sheets = 0;
+
     free(convert->images);
     convert->images = NULL;
 
+    free(convert->convs);
+    convert->convs = NULL;
+
     free(convert->name);
     convert->name = NULL;
 
@@ -296,86 +378,100 @@ error:
     return -1;
 }
 
-static bool convert_image(struct convert *convert, struct image *image)
+static void convert_stages(const struct convert *convert, struct image_stages *stages)
 {
-    if (convert_is_palette_style(convert))
+    stages->offset = convert->palette_offset;
+    stages->rlet = convert->style == CONVERT_STYLE_RLET;
+    stages->transparent_index = convert->palette_offset + convert->transparent_index;
+    stages->omit_indices = convert->omit_indices;
+    stages->nr_omit_indices = convert->nr_omit_indices;
+    stages->bpp = convert->bpp;
+    stages->nr_palette_entries = 0;
+    stages->width_and_height = convert->width_height != CONVERT_NO_WIDTH_HEIGHT;
+    stages->swap_width_height = convert->width_height == CONVERT_SWAP_WIDTH_HEIGHT;
+}
+
+static bool convert_image_compress(struct convert *convert, struct image *image)
+{
+    image->uncompressed_size = image->data_size;
+
+    if (convert->compress != COMPRESS_NONE)
     {
-        if (image_quantize(image, convert->palette))
+        if (image_compress(image, convert->compress, convert->compress_min_gain,
+                convert->compress_tolerance))
         {
             return false;
         }
 
-        if (convert->palette_offset != 0)
-        {
-            if (convert->palette_offset + convert->palette->nr_entries >=
-                PALETTE_MAX_ENTRIES)
-            {
-                LOG_ERROR("Palette offset places indices out of range for "
-                        "convert \'%s\'\n",
-                    convert->name);
-                return false;
-            }
+        /* stored data is written out like uncompressed data */
+        image->compressed = image->compression != COMPRESS_NONE;
+        image->stored = !image->compressed;
+    }
 
-            if (image_add_offset(image, convert->palette_offset))
-            {
-                return false;
-            }
-        }
+    return true;
+}
 
-        if (convert->style == CONVERT_STYLE_RLET)
-        {
-            if (image_rlet(image, convert->palette_offset + convert->transparent_index))
-            {
-                return false;
-            }
-        }
+/* runs everything after quantization on palette indices */
+static bool convert_image_indexed(struct convert *convert, struct image *image)
+{
+    struct image_stages stages;
 
-        if (convert->nr_omit_indices)
-        {
-            if (image_remove_omits(image, convert->omit_indices, convert->nr_omit_indices))
-            {
-                return false;
-            }
-        }
+    convert_stages(convert, &stages);
 
-        if (convert->bpp != BPP_8)
-        {
-            if (image_set_bpp(image, convert->bpp, convert->palette->nr_entries))
-            {
-                return false;
-            }
-        }
-    }
-    else
+    if (convert->palette_offset != 0)
     {
-        if (image_direct_convert(image, convert->color_fmt))
+        if (convert->palette_offset + convert->palette->nr_entries >=
+            PALETTE_MAX_ENTRIES)
         {
+            LOG_ERROR("Palette offset places indices out of range for "
+                    "convert \'%s\'\n",
+                convert->name);
             return false;
         }
     }
 
-    if (convert->width_height == CONVERT_ADD_WIDTH_HEIGHT ||
-        convert->width_height == CONVERT_SWAP_WIDTH_HEIGHT)
+    image->converted_size = image->data_size;
+
+    /* offset, rlet, omits, bpp, and width/height in one pass */
+    stages.nr_palette_entries = convert->palette->nr_entries;
+
+    if (image_apply_stages(image, &stages))
     {
-        if (image_add_width_and_height(image, convert->width_height == CONVERT_SWAP_WIDTH_HEIGHT))
-        {
-            return false;
-        }
+        return false;
     }
 
-    image->uncompressed_size = image->data_size;
+    return convert_image_compress(convert, image);
+}
 
-    if (convert->compress != COMPRESS_NONE)
+static bool convert_image(struct convert *convert, struct image *image)
+{
+    struct image_stages stages;
+    double start = report_clock();
+
+    if (convert_is_palette_style(convert))
     {
-        if (image_compress(image, convert->compress))
+        if (image_quantize(image, convert->palette))
         {
             return false;
         }
 
-        image->compressed = true;
+        image->quantize_time = report_clock() - start;
+
+        return convert_image_indexed(convert, image);
     }
 
-    return true;
+    convert_stages(convert, &stages);
+
+    if (image_direct_convert(image, convert->color_fmt, &stages))
+    {
+        return false;
+    }
+
+    /* direct conversion applies the stages in the same pass */
+    image->quantize_time = report_clock() - start;
+    image->converted_size = image->data_size;
+
+    return convert_image_compress(convert, image);
 }
 
 static bool convert_image_thread(void *arg)
@@ -383,6 +479,7 @@ static bool convert_image_thread(void *arg)
     struct conv *conv = arg;
     struct convert *convert = conv->convert;
     struct image *image = conv->image;
+    bool ret;
 
     /* assign image constants from convert */
     image->quantize_speed = convert->quantize_speed;
@@ -413,89 +510,301 @@ static bool convert_image_thread(void *arg)
         image->gfx = true;
     }
 
-    LOG_INFO(" - Reading image \'%s\'\n", image->path);
+    /* dimensions were validated by convert_probe */
+    if (image->sheet != NULL)
+    {
+        ret = !sheet_extract(image) && convert_image(convert, image);
+
+        sheet_release(image->sheet);
+    }
+    else
+    {
+        LOG_INFO(" - Reading image \'%s\'\n", image->path);
+
+        ret = !image_load(image) && convert_image(convert, image);
+    }
+
+    if (!ret)
+    {
+        /* the pixels may be task memory, which is gone after this returns */
+        image_release_pixels(image);
+        return false;
+    }
+
+    if (convert->done != NULL && convert->done(convert, image, NULL))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static bool convert_tileset_hash_band(void *arg)
+{
+    struct conv *conv = arg;
+
+    if (!tileset_hash_band(conv->tileset, conv->band))
+    {
+        conv->tileset->hash_error = true;
+    }
+
+    atomic_fetch_sub(&conv->tileset->nr_pending_hash_bands, 1);
+
+    /* failures are reported through the tileset, so a failed start always
+     * means the row never ran, even when the pool runs it inline */
+    return true;
+}
+
+/* hashes every row of tiles on the pool, and waits for just those rows */
+static int convert_tileset_hash(struct convert *convert, struct tileset *tileset, struct conv *convs)
+{
+    uint32_t nr_bands = tileset->image.height / tileset->tile_height;
 
-    if (image_load(image))
+    if (tileset_hash_begin(tileset))
     {
         return -1;
     }
 
-    if (convert->width_height != CONVERT_NO_WIDTH_HEIGHT)
+    tileset->hash_error = false;
+    tileset->nr_pending_hash_bands = nr_bands;
+
+    for (uint32_t i = 0; i < nr_bands; ++i)
     {
-        if (image->width > 255)
-        {
-            LOG_ERROR("Image \'%s\' width is %u. "
-                "Maximum width is 255 when using the option \'width-and-height\'.\n",
-                image->name,
-                image->width);
-            return false;
-        }
+        struct conv *conv = &convs[i];
+
+        conv->convert = convert;
+        conv->image = NULL;
+        conv->tileset = tileset;
+        conv->band = i;
 
-        if (image->height > 255)
+        if (!thread_start(convert_tileset_hash_band, conv))
         {
-            LOG_ERROR("Image \'%s\' height is %u. "
-                "Maximum height is 255 when using the option \'width-and-height\'.\n",
-                image->name,
-                image->height);
-            return false;
+            /* the rows never started will not count themselves down */
+            atomic_fetch_sub(&tileset->nr_pending_hash_bands, nr_bands - i);
+            tileset->hash_error = true;
+            break;
         }
     }
 
-    bool ret = convert_image(convert, image);
-
-    free(arg);
+    /* other tasks keep running on the pool meanwhile */
+    while (tileset->nr_pending_hash_bands != 0)
+    {
+        thrd_yield();
+    }
 
-    return ret;
+    return tileset->hash_error ? -1 : 0;
 }
 
-static bool convert_tileset(struct convert *convert, struct tileset *tileset)
+static int convert_tileset_begin(struct convert *convert, struct tileset *tileset, struct conv *convs)
 {
     uint32_t nr_tiles;
-    uint32_t x;
-    uint32_t y;
 
     if (!tileset->tile_width || tileset->image.width % tileset->tile_width)
     {
         LOG_ERROR("Image dimensions do not support tile width.\n");
-        return false;
+        return -1;
     }
 
     if (!tileset->tile_height || tileset->image.height % tileset->tile_height)
     {
         LOG_ERROR("Image dimensions do not support tile height.\n");
-        return false;
+        return -1;
     }
 
     nr_tiles =
         (tileset->image.width / tileset->tile_width) *
         (tileset->image.height / tileset->tile_height);
 
-    if (tileset_alloc_tiles(tileset, nr_tiles))
+    tileset->rlet = convert->style == CONVERT_STYLE_RLET;
+    tileset->compressed = convert->compress != COMPRESS_NONE;
+    tileset->stored = false;
+
+    /* tiles view the decoded pixels, so round alpha once up front */
+    if (convert_is_palette_style(convert) &&
+        cpu_kernels.clamp_alpha(tileset->image.data, tileset->image.width * tileset->image.height))
     {
-        return false;
+        LOG_WARNING("Partially transparent pixels were rounded to fully transparent or fully opaque.\n");
+        LOG_WARNING("This may result in incorrect image conversion.\n");
     }
 
-    tileset->rlet = convert->style == CONVERT_STYLE_RLET;
-    tileset->compressed = convert->compress != COMPRESS_NONE;
+    /* compare the final pixels, so only identical tiles merge */
+    if (tileset->deduplicate != TILESET_DEDUPLICATE_NONE)
+    {
+        if (convert_tileset_hash(convert, tileset, convs))
+        {
+            return -1;
+        }
+
+        if (tileset_deduplicate(tileset))
+        {
+            return -1;
+        }
+    }
+    else if (tileset_alloc_tiles(tileset, nr_tiles))
+    {
+        return -1;
+    }
+
+    /* one quantization for the whole tileset, tiles are sliced after */
+    if (tileset->quantize_once && convert_is_palette_style(convert))
+    {
+        double start = report_clock();
+
+        if (image_quantize(&tileset->image, convert->palette))
+        {
+            return -1;
+        }
+
+        tileset->image.quantize_time = report_clock() - start;
+
+        tileset->indexed = true;
+    }
+
+    tileset->nr_pending_bands = tileset->image.height / tileset->tile_height;
+
+    return 0;
+}
+
+/* finds the first kept tile that comes from at or after a source tile */
+static uint32_t convert_tileset_first_tile(const struct tileset *tileset, uint32_t source)
+{
+    uint32_t lo = 0;
+    uint32_t hi = tileset->nr_tiles;
+
+    if (tileset->tile_sources == NULL)
+    {
+        return source;
+    }
 
-    y = 0;
-    x = 0;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (tileset->tile_sources[mid] < source)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void convert_tile_flip_x(uint8_t *data, uint32_t width, uint32_t height, bool indexed)
+{
+    if (!indexed)
+    {
+        image_flip_x((uint32_t *)data, width, height);
+        return;
+    }
+
+    for (uint32_t r = 0; r < height / 2; ++r)
+    {
+        uint8_t *top = data + (r * width);
+        uint8_t *bottom = data + (height - 1 - r) * width;
+
+        for (uint32_t c = 0; c < width; ++c)
+        {
+            uint8_t temp = top[c];
+            top[c] = bottom[c];
+            bottom[c] = temp;
+        }
+    }
+}
+
+static void convert_tile_flip_y(uint8_t *data, uint32_t width, uint32_t height, bool indexed)
+{
+    if (!indexed)
+    {
+        image_flip_y((uint32_t *)data, width, height);
+        return;
+    }
+
+    for (uint32_t r = 0; r < height; ++r)
+    {
+        uint8_t *row = data + (r * width);
+
+        for (uint32_t c = 0; c < width / 2; ++c)
+        {
+            uint8_t temp = row[c];
+            row[c] = row[width - 1 - c];
+            row[width - 1 - c] = temp;
+        }
+    }
+}
+
+/* same layout as image_rotate_90, on palette indices */
+static int convert_tile_rotate_90(uint8_t *data, uint32_t width, uint32_t height, bool indexed)
+{
+    uint8_t *new_data;
+
+    if (!indexed)
+    {
+        return image_rotate_90((uint32_t *)data, width, height);
+    }
+
+    new_data = memory_arena_alloc(width * height);
+    if (new_data == NULL)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < height; ++i)
+    {
+        const uint8_t *row = data + (height - 1 - i) * width;
+
+        for (uint32_t j = 0; j < width; ++j)
+        {
+            new_data[i + j * height] = row[j];
+        }
+    }
+
+    memcpy(data, new_data, width * height);
+    memory_arena_free(new_data);
+
+    return 0;
+}
 
-    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+/* converts one row of tiles, reading the tileset pixels in place */
+static bool convert_tileset_band(void *arg)
+{
+    struct conv *conv = arg;
+    struct convert *convert = conv->convert;
+    struct tileset *tileset = conv->tileset;
+    uint32_t pixel_size = tileset->indexed ? 1 : sizeof(uint32_t);
+    uint32_t tiles_per_band = tileset->image.width / tileset->tile_width;
+    uint32_t image_stride = tileset->image.width * pixel_size;
+    uint32_t tile_stride = tileset->tile_width * pixel_size;
+    const uint8_t *band = tileset->image.data + (conv->band * tileset->tile_height * image_stride);
+    uint32_t first = conv->band * tiles_per_band;
+    bool transform;
+    bool ret = true;
+
+    transform = tileset->tile_flip_x || tileset->tile_flip_y || tileset->tile_rotate != 0;
+
+    /* duplicates are skipped, their first copy is converted instead */
+    for (uint32_t index = convert_tileset_first_tile(tileset, first); index < tileset->nr_tiles; ++index)
     {
-        uint32_t tile_dim = tileset->tile_width * tileset->tile_height;
-        uint32_t tile_data_size = tile_dim * sizeof(uint32_t);
-        uint32_t tile_stride = tileset->tile_width * sizeof(uint32_t);
-        uint32_t image_stride = tileset->image.width * sizeof(uint32_t);
-        void *tile_data = tileset->tiles[i].data;
-        uint8_t *dst;
+        uint32_t source = tileset->tile_sources != NULL ? tileset->tile_sources[index] : index;
+        const uint8_t *origin;
+
+        if (source >= first + tiles_per_band)
+        {
+            break;
+        }
+
+        origin = band + ((source - first) * tile_stride);
 
         struct image tile =
         {
-            .data = tile_data,
-            .data_size = tile_data_size,
+            .data = (uint8_t *)origin,
+            .data_size = tileset->tile_width * tileset->tile_height * pixel_size,
             .width = tileset->tile_width,
             .height = tileset->tile_height,
+            .stride = tileset->image.width,
             .transparent_index = convert->transparent_index,
             .quantize_speed = convert->quantize_speed,
             .dither = convert->dither,
@@ -503,83 +812,370 @@ static bool convert_tileset(struct convert *convert, struct tileset *tileset)
             .path = NULL,
         };
 
-        dst = tile_data;
+        /* transformed and indexed tiles need their own copy */
+        if (transform || tileset->indexed)
+        {
+            uint8_t *tile_data = memory_arena_alloc(tile.data_size);
+            uint8_t *dst = tile_data;
+            bool indexed = tileset->indexed;
 
-        for (uint32_t j = 0; j < tile.height; ++j)
+            if (tile_data == NULL)
+            {
+                ret = false;
+                break;
+            }
+
+            for (uint32_t j = 0; j < tile.height; ++j)
+            {
+                memcpy(dst, origin + (j * image_stride), tile_stride);
+                dst += tile_stride;
+            }
+
+            tile.data = tile_data;
+            tile.stride = 0;
+
+            if (tileset->tile_flip_x)
+            {
+                convert_tile_flip_x(tile_data, tile.width, tile.height, indexed);
+            }
+
+            if (tileset->tile_flip_y)
+            {
+                convert_tile_flip_y(tile_data, tile.width, tile.height, indexed);
+            }
+
+            switch (tileset->tile_rotate)
+            {
+                default:
+                case 0:
+                    break;
+
+                case 90:
+                    tile.width = tileset->tile_height;
+                    tile.height = tileset->tile_width;
+                    if (convert_tile_rotate_90(tile_data, tile.width, tile.height, indexed))
+                    {
+                        goto error;
+                    }
+                    break;
+
+                case 180:
+                    convert_tile_flip_y(tile_data, tile.width, tile.height, indexed);
+                    convert_tile_flip_x(tile_data, tile.width, tile.height, indexed);
+                    break;
+
+                case 270:
+                    tile.width = tileset->tile_height;
+                    tile.height = tileset->tile_width;
+                    if (convert_tile_rotate_90(tile_data, tile.width, tile.height, indexed))
+                    {
+                        goto error;
+                    }
+                    convert_tile_flip_y(tile_data, tile.width, tile.height, indexed);
+                    convert_tile_flip_x(tile_data, tile.width, tile.height, indexed);
+                    break;
+            }
+        }
+
+        if (tileset->indexed ? !convert_image_indexed(convert, &tile) : !convert_image(convert, &tile))
         {
-            uint32_t o = (j * image_stride) + y;
+error:
+            if (tile.stride == 0)
+            {
+                memory_arena_free(tile.data);
+            }
+            ret = false;
+            break;
+        }
 
-            memcpy(dst, &tileset->image.data[x + o], tile_stride);
+        tileset->tiles[index].data_size = tile.data_size;
+        tileset->tiles[index].data = tile.data;
+        tileset->tiles[index].compression = tile.compression;
+        tileset->tiles[index].decompress_delta = tile.decompress_delta;
+        tileset->tiles[index].converted_size = tile.converted_size;
+        tileset->tiles[index].uncompressed_size = tile.uncompressed_size;
+        tileset->tiles[index].quantize_time = tile.quantize_time;
+        tileset->tiles[index].compress_stats = tile.compress_stats;
+    }
 
-            dst += tile_stride;
+    /* the last band releases the source pixels */
+    if (atomic_fetch_sub(&tileset->nr_pending_bands, 1) == 1)
+    {
+        free(tileset->image.data);
+        tileset->image.data = NULL;
+
+        /* a tileset with every tile stored is written out uncompressed */
+        if (ret && tileset->compressed && tileset->nr_tiles != 0 &&
+            tileset_compression(tileset) == COMPRESS_NONE)
+        {
+            tileset->compressed = false;
+            tileset->stored = true;
         }
 
-        if (tileset->tile_flip_x)
+        if (ret && convert->done != NULL && convert->done(convert, NULL, tileset))
         {
-            image_flip_x(tile_data, tile.width, tile.height);
+            ret = false;
         }
+    }
+
+    return ret;
+}
+
+/* rough peak memory of converting pixels, used to budget threads */
+static size_t convert_footprint(const struct convert *convert, size_t nr_pixels, bool decoded)
+{
+    size_t size = 0;
+
+    /* decoded rgba pixels, unless they are shared views */
+    if (decoded)
+    {
+        size += nr_pixels * sizeof(uint32_t);
+    }
+
+    if (decoded && (convert->rotate == 90 || convert->rotate == 270))
+    {
+        size += nr_pixels * sizeof(uint32_t);
+    }
+
+    if (convert_is_palette_style(convert))
+    {
+        /* quantizer working set plus the index buffer */
+        size += nr_pixels * sizeof(uint32_t) + nr_pixels;
+    }
+    else
+    {
+        size += nr_pixels * sizeof(uint16_t);
+    }
 
-        if (tileset->tile_flip_y)
+    if (convert->compress != COMPRESS_NONE)
+    {
+        size += nr_pixels * sizeof(uint16_t);
+    }
+
+    return size;
+}
+
+/* reads an image header and sets its dimensions after rotation */
+static int convert_probe_image(const struct convert *convert, struct image *image)
+{
+    uint32_t width;
+    uint32_t height;
+
+    if (image_probe(image, &width, &height))
+    {
+        LOG_ERROR("Could not load image \'%s\'.\n", image->path);
+        return -1;
+    }
+
+    if (convert->rotate == 90 || convert->rotate == 270)
+    {
+        image->width = height;
+        image->height = width;
+    }
+    else
+    {
+        image->width = width;
+        image->height = height;
+    }
+
+    return 0;
+}
+
+static int convert_probe_bpp(const struct convert *convert, uint32_t width)
+{
+    uint32_t multiple;
+
+    if (!convert_is_palette_style(convert))
+    {
+        return 0;
+    }
+
+    switch (convert->bpp)
+    {
+        case BPP_1: multiple = 8; break;
+        case BPP_2: multiple = 4; break;
+        case BPP_4: multiple = 2; break;
+        default: multiple = 1; break;
+    }
+
+    if (width % multiple)
+    {
+        LOG_ERROR("Image width is not a multiple of the BPP (needs to be multiple of %u).\n",
+            multiple);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* turns each sheet rectangle into an image that views the sheet */
+static int convert_probe_sheets(struct convert *convert)
+{
+    for (uint32_t i = 0; i < convert->nr_sheets; ++i)
+    {
+        struct sheet *sheet = &convert->sheets[i];
+        uint32_t width;
+        uint32_t height;
+
+        if (image_probe(&sheet->image, &width, &height))
         {
-            image_flip_y(tile_data, tile.width, tile.height);
+            LOG_ERROR("Could not load sheet \'%s\'.\n", sheet->image.path);
+            return -1;
         }
 
-        switch (tileset->tile_rotate)
+        sheet->image.width = width;
+        sheet->image.height = height;
+
+        if (sheet->sprite_width || sheet->sprite_height)
         {
-            default:
-            case 0:
-                break;
+            if (!sheet->sprite_width || !sheet->sprite_height)
+            {
+                LOG_ERROR("Sheet \'%s\' needs both a sprite width and height.\n",
+                    sheet->image.path);
+                return -1;
+            }
 
-            case 90:
-                tile.width = tileset->tile_height;
-                tile.height = tileset->tile_width;
-                if (image_rotate_90(tile_data, tile.width, tile.height))
-                {
-                    goto error;
-                }
-                break;
+            if (sheet_build_grid(sheet))
+            {
+                return -1;
+            }
+        }
 
-            case 180:
-                image_flip_y(tile_data, tile.width, tile.height);
-                image_flip_x(tile_data, tile.width, tile.height);
-                break;
+        for (uint32_t j = 0; j < sheet->nr_sprites; ++j)
+        {
+            const struct sheet_sprite *sprite = &sheet->sprites[j];
+            struct image *image;
 
-            case 270:
-                tile.width = tileset->tile_height;
-                tile.height = tileset->tile_width;
-                if (image_rotate_90(tile_data, tile.width, tile.height))
-                {
-                    goto error;
-                }
-                image_flip_y(tile_data, tile.width, tile.height);
-                image_flip_x(tile_data, tile.width, tile.height);
-                break;
+            if (!sprite->width || !sprite->height ||
+                sprite->x + sprite->width > width ||
+                sprite->y + sprite->height > height)
+            {
+                LOG_ERROR("Sprite \'%s\' is outside of sheet \'%s\'.\n",
+                    sprite->name, sheet->image.path);
+                return -1;
+            }
+
+            if (convert_add_image(convert, sheet->image.path))
+            {
+                return -1;
+            }
+
+            image = &convert->images[convert->nr_images - 1];
+
+            free(image->name);
+            image->name = strings_dup(sprite->name);
+            if (image->name == NULL)
+            {
+                return -1;
+            }
+
+            image->sheet = sheet;
+            image->sheet_x = sprite->x;
+            image->sheet_y = sprite->y;
+
+            if (convert->rotate == 90 || convert->rotate == 270)
+            {
+                image->width = sprite->height;
+                image->height = sprite->width;
+            }
+            else
+            {
+                image->width = sprite->width;
+                image->height = sprite->height;
+            }
         }
+    }
 
-        x += tile_stride;
+    return 0;
+}
+
+int convert_probe(struct convert *convert)
+{
+    if (convert_probe_sheets(convert))
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        struct image *image = &convert->images[i];
 
-        if (x >= image_stride)
+        if (image->sheet == NULL && convert_probe_image(convert, image))
         {
-            x = 0;
-            y += tileset->tile_height * image_stride;
+            return -1;
         }
 
-        if (!convert_image(convert, &tile))
+        if (convert->width_height != CONVERT_NO_WIDTH_HEIGHT)
         {
-error:
-            free(tile.data);
-            return false;
+            if (image->width > 255)
+            {
+                LOG_ERROR("Image \'%s\' width is %u. "
+                    "Maximum width is 255 when using the option \'width-and-height\'.\n",
+                    image->name,
+                    image->width);
+                return -1;
+            }
+
+            if (image->height > 255)
+            {
+                LOG_ERROR("Image \'%s\' height is %u. "
+                    "Maximum height is 255 when using the option \'width-and-height\'.\n",
+                    image->name,
+                    image->height);
+                return -1;
+            }
         }
 
-        tileset->tiles[i].data_size = tile.data_size;
-        tileset->tiles[i].data = tile.data;
+        if (convert_probe_bpp(convert, image->width))
+        {
+            LOG_ERROR("Invalid width for image \'%s\'.\n", image->path);
+            return -1;
+        }
     }
 
-    return true;
+    for (uint32_t i = 0; i < convert->nr_tilesets; ++i)
+    {
+        struct tileset *tileset = &convert->tilesets[i];
+        struct image *image = &tileset->image;
+        uint32_t tile_width;
+
+        if (convert_probe_image(convert, image))
+        {
+            return -1;
+        }
+
+        if (!convert->tile_width || image->width % convert->tile_width)
+        {
+            LOG_ERROR("Image dimensions do not support tile width.\n");
+            return -1;
+        }
+
+        if (!convert->tile_height || image->height % convert->tile_height)
+        {
+            LOG_ERROR("Image dimensions do not support tile height.\n");
+            return -1;
+        }
+
+        tile_width = convert->tile_width;
+        if (convert->tile_rotate == 90 || convert->tile_rotate == 270)
+        {
+            tile_width = convert->tile_height;
+        }
+
+        if (convert_probe_bpp(convert, tile_width))
+        {
+            LOG_ERROR("Invalid tile width for tileset \'%s\'.\n", image->path);
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 int convert_generate(struct convert *convert, struct palette **palettes, uint32_t nr_palettes)
 {
+    uint32_t nr_convs;
+
     if (convert->nr_images == 0 && convert->nr_tilesets == 0)
     {
         LOG_WARNING("No images or tilesets in convert \'%s\'\n",
@@ -597,34 +1193,94 @@ int convert_generate(struct convert *convert, struct palette **palettes, uint32_
         }
     }
 
-    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    /* one block for all tasks, released with the convert */
+    nr_convs = convert->nr_images;
+    for (uint32_t i = 0; i < convert->nr_tilesets; ++i)
+    {
+        if (convert->tile_height != 0)
+        {
+            nr_convs += convert->tilesets[i].image.height / convert->tile_height;
+        }
+    }
+
+    if (nr_convs != 0)
+    {
+        convert->convs = memory_realloc_array(NULL, nr_convs, sizeof(struct conv));
+        if (convert->convs == NULL)
+        {
+            return -1;
+        }
+    }
+
+    nr_convs = convert->nr_images;
+
+    for (uint32_t i = 0; i < convert->nr_sheets; ++i)
     {
-        struct conv *conv = malloc(sizeof(struct conv));
-        if (!conv)
+        if (sheet_load(&convert->sheets[i], convert_is_palette_style(convert)))
         {
             return -1;
         }
+    }
+
+    for (uint32_t i = 0; i < CONVERT_PREFETCH_AHEAD && i < convert->nr_images; ++i)
+    {
+        image_prefetch(&convert->images[i]);
+    }
+
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        struct conv *conv = &convert->convs[i];
+
+        /* keep readahead a few images ahead of the queue */
+        if (i + CONVERT_PREFETCH_AHEAD < convert->nr_images)
+        {
+            image_prefetch(&convert->images[i + CONVERT_PREFETCH_AHEAD]);
+        }
 
         conv->convert = convert;
         conv->image = &convert->images[i];
+        conv->tileset = NULL;
+        conv->band = 0;
 
-        if (!thread_start(convert_image_thread, conv))
+        if (!thread_start_sized(convert_image_thread, conv,
+                convert_footprint(convert,
+                    (size_t)conv->image->width * conv->image->height,
+                    conv->image->sheet == NULL)))
         {
             return -1;
         }
     }
 
+    if (convert->nr_tilesets != 0)
+    {
+        image_prefetch(&convert->tilesets[0].image);
+    }
+
     for (uint32_t j = 0; j < convert->nr_tilesets; ++j)
     {
         struct tileset *tileset = &convert->tilesets[j];
         struct image *image = &tileset->image;
 
+        if (j + 1 < convert->nr_tilesets)
+        {
+            image_prefetch(&convert->tilesets[j + 1].image);
+        }
+
         /* assign tileset constants from convert */
         tileset->tile_height = convert->tile_height;
         tileset->tile_width = convert->tile_width;
         tileset->tile_rotate = convert->tile_rotate;
         tileset->tile_flip_x = convert->tile_flip_x;
         tileset->tile_flip_y = convert->tile_flip_y;
+        tileset->deduplicate = convert->tile_deduplicate;
+        tileset->quantize_once = convert->tile_quantize_once;
+        tileset->tilemap = convert->tilemap;
+
+        /* levels are split into their unique tiles */
+        if (tileset->tilemap && tileset->deduplicate == TILESET_DEDUPLICATE_NONE)
+        {
+            tileset->deduplicate = TILESET_DEDUPLICATE_EXACT;
+        }
         tileset->p_table = convert->p_table;
 
         /* assign image constants from convert */
@@ -663,10 +1319,27 @@ int convert_generate(struct convert *convert, struct palette **palettes, uint32_
             return -1;
         }
 
-        if (!convert_tileset(convert, tileset))
+        if (convert_tileset_begin(convert, tileset, &convert->convs[nr_convs]))
         {
             return -1;
         }
+
+        /* each band of tile rows is its own task */
+        for (uint32_t k = 0; k < image->height / tileset->tile_height; ++k)
+        {
+            struct conv *conv = &convert->convs[nr_convs++];
+
+            conv->convert = convert;
+            conv->image = NULL;
+            conv->tileset = tileset;
+            conv->band = k;
+
+            if (!thread_start_sized(convert_tileset_band, conv,
+                    convert_footprint(convert, (size_t)image->width * tileset->tile_height, false)))
+            {
+                return -1;
+            }
+        }
     }
 
     return 0;
@@ -34,6 +34,7 @@
 #include "image.h"
 #include "palette.h"
 #include "tileset.h"
+#include "sheet.h"
 #include "compress.h"
 
 #ifdef __cplusplus
@@ -42,6 +43,8 @@ extern "C" {
 
 #define CONVERT_DEFAULT_QUANTIZE_SPEED 3
 
+struct conv;
+
 typedef enum
 {
     CONVERT_STYLE_PALETTE,
@@ -69,12 +72,17 @@ struct convert
     uint8_t transparent_index;
     struct image *images;
     uint32_t nr_images;
+    struct conv *convs;
     struct tileset *tilesets;
     uint32_t nr_tilesets;
+    struct sheet *sheets;
+    uint32_t nr_sheets;
     uint32_t tile_height;
     uint32_t tile_width;
     bool p_table;
     compress_mode_t compress;
+    uint32_t compress_min_gain;
+    uint32_t compress_tolerance;
     convert_style_t style;
     color_format_t color_fmt;
     uint32_t quantize_speed;
@@ -86,7 +94,14 @@ struct convert
     uint32_t tile_rotate;
     bool tile_flip_x;
     bool tile_flip_y;
+    tileset_deduplicate_t tile_deduplicate;
+    bool tile_quantize_once;
+    bool tilemap;
     bpp_t bpp;
+
+    /* called as each image or tileset finishes when streaming */
+    int (*done)(struct convert *convert, struct image *image, struct tileset *tileset);
+    uint32_t nr_output_refs;
 };
 
 struct convert *convert_alloc(void);
@@ -95,6 +110,10 @@ int convert_add_image_path(struct convert *convert, const char *path);
 
 int convert_add_tileset_path(struct convert *convert, const char *path);
 
+struct sheet *convert_add_sheet(struct convert *convert, const char *path);
+
+int convert_probe(struct convert *convert);
+
 int convert_generate(struct convert *convert, struct palette **palettes, uint32_t nr_palettes);
 
 void convert_free(struct convert *convert);
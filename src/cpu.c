@@ -0,0 +1,918 @@
+/*
+ * Copyright 2017-2026 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "cpu.h"
+#include "log.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_X86
+#define CPU_TARGET(x) __attribute__((target(x)))
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define CPU_NEON
+#include <arm_neon.h>
+#if !defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+static const char *cpu_level_names[] =
+{
+    [CPU_LEVEL_GENERIC] = "generic",
+    [CPU_LEVEL_SSE2] = "sse2",
+    [CPU_LEVEL_SSSE3] = "ssse3",
+    [CPU_LEVEL_AVX2] = "avx2",
+    [CPU_LEVEL_NEON] = "neon",
+};
+
+static uint32_t generic_span_equal(const uint8_t *data, uint32_t len, uint8_t value)
+{
+    uint32_t i = 0;
+
+    while (i < len && data[i] == value)
+    {
+        i++;
+    }
+
+    return i;
+}
+
+/* compacts data[i..size) onto data[n..], returns the new size */
+static uint32_t cpu_compact_tail(uint8_t *data, uint32_t i, uint32_t n, uint32_t size, const uint32_t *mask)
+{
+    for (; i < size; ++i)
+    {
+        uint8_t byte = data[i];
+
+        data[n] = byte;
+        n += !((mask[byte >> 5] >> (byte & 31)) & 1);
+    }
+
+    return n;
+}
+
+static uint32_t generic_compact(uint8_t *data, uint32_t size, const uint32_t *mask)
+{
+    return cpu_compact_tail(data, 0, 0, size, mask);
+}
+
+static bool generic_clamp_alpha(uint8_t *data, uint32_t nr_pixels)
+{
+    uint8_t changed = 0;
+
+    for (uint32_t i = 0; i < nr_pixels; ++i)
+    {
+        uint8_t *a = &data[(i * 4) + 3];
+        uint8_t rounded = -(*a >> 7);
+
+        changed |= *a ^ rounded;
+        *a = rounded;
+    }
+
+    return changed != 0;
+}
+
+static void generic_reverse(uint32_t *data, uint32_t count)
+{
+    for (uint32_t c = 0; c < count / 2; ++c)
+    {
+        uint32_t temp = data[c];
+        data[c] = data[count - c - 1];
+        data[count - c - 1] = temp;
+    }
+}
+
+/* rotates source rows starting at row first */
+static void cpu_rotate_rows(uint32_t *dst, const uint32_t *src, uint32_t width, uint32_t height, uint32_t first)
+{
+    for (uint32_t i = first; i < height; ++i)
+    {
+        uint32_t o = (height - 1 - i) * width;
+
+        for (uint32_t j = 0; j < width; ++j)
+        {
+            dst[i + j * height] = src[o + j];
+        }
+    }
+}
+
+static void generic_rotate_90(uint32_t *dst, const uint32_t *src, uint32_t width, uint32_t height)
+{
+    cpu_rotate_rows(dst, src, width, height, 0);
+}
+
+static void generic_pack(uint8_t *dst, const uint8_t *src, uint32_t size, uint8_t shift)
+{
+    uint8_t inc = 8 / shift;
+
+    for (uint32_t k = 0; k < size; k += inc)
+    {
+        uint8_t cur_inc = inc;
+        uint8_t byte = 0;
+
+        for (uint8_t col = 0; col < inc; col++)
+        {
+            byte |= src[k + col] << (--cur_inc * shift);
+        }
+
+        *dst++ = byte;
+    }
+}
+
+static bool generic_convert_16(uint8_t *dst, const uint8_t *src, uint32_t nr_pixels, color_format_t fmt)
+{
+    bool bad_alpha = false;
+
+    for (uint32_t i = 0; i < nr_pixels; ++i)
+    {
+        struct color color;
+        uint16_t target;
+
+        color.r = src[0];
+        color.g = src[1];
+        color.b = src[2];
+
+        /* the user might get bad colors if alpha is set */
+        if (src[3] != 255)
+        {
+            bad_alpha = true;
+        }
+
+        switch (fmt)
+        {
+            case COLOR_1555_GRGB:
+                target = color_to_1555_grgb(&color);
+                break;
+
+            case COLOR_565_BGR:
+                target = color_to_565_bgr(&color);
+                break;
+
+            default:
+            case COLOR_565_RGB:
+                target = color_to_565_rgb(&color);
+                break;
+        }
+
+        *dst++ = target & 255;
+        *dst++ = (target >> 8) & 255;
+        src += 4;
+    }
+
+    return bad_alpha;
+}
+
+#if defined(CPU_X86)
+
+/* splits a 256-bit mask into nibble lookups for pshufb: the low nibble */
+/* selects the row, the high nibble selects the bit (8-15 in hi_table) */
+static void cpu_compact_tables(const uint32_t *mask, uint8_t *lo_table, uint8_t *hi_table)
+{
+    for (uint32_t lo = 0; lo < 16; ++lo)
+    {
+        lo_table[lo] = 0;
+        hi_table[lo] = 0;
+
+        for (uint32_t hi = 0; hi < 16; ++hi)
+        {
+            uint32_t value = (hi << 4) | lo;
+
+            if ((mask[value >> 5] >> (value & 31)) & 1)
+            {
+                if (hi < 8)
+                {
+                    lo_table[lo] |= 1 << hi;
+                }
+                else
+                {
+                    hi_table[lo] |= 1 << (hi - 8);
+                }
+            }
+        }
+    }
+}
+
+static const uint8_t cpu_bit_table[16] =
+    { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+
+CPU_TARGET("sse2")
+static uint32_t sse2_span_equal(const uint8_t *data, uint32_t len, uint8_t value)
+{
+    const __m128i match = _mm_set1_epi8((char)value);
+    uint32_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, match)) ^ 0xffff;
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + generic_span_equal(data + i, len - i, value);
+}
+
+CPU_TARGET("sse2")
+static bool sse2_clamp_alpha(uint8_t *data, uint32_t nr_pixels)
+{
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i diff = zero;
+    uint32_t i = 0;
+    bool changed;
+
+    for (; i + 4 <= nr_pixels; i += 4)
+    {
+        __m128i *ptr = (__m128i *)(data + (i * 4));
+        __m128i pixels = _mm_loadu_si128(ptr);
+
+        /* bytes >= 128 compare as negative, giving 255 or 0 */
+        __m128i rounded = _mm_or_si128(
+            _mm_and_si128(_mm_cmplt_epi8(pixels, zero), alpha),
+            _mm_andnot_si128(alpha, pixels));
+
+        diff = _mm_or_si128(diff, _mm_xor_si128(pixels, rounded));
+        _mm_storeu_si128(ptr, rounded);
+    }
+
+    changed = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xffff;
+
+    return generic_clamp_alpha(data + (i * 4), nr_pixels - i) || changed;
+}
+
+CPU_TARGET("sse2")
+static void sse2_reverse(uint32_t *data, uint32_t count)
+{
+    uint32_t *l = data;
+    uint32_t *r = data + count;
+
+    /* swap blocks of 4 from both ends, reversing each block */
+    while (r - l >= 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)l);
+        __m128i b = _mm_loadu_si128((const __m128i *)(r - 4));
+
+        _mm_storeu_si128((__m128i *)l, _mm_shuffle_epi32(b, 0x1b));
+        _mm_storeu_si128((__m128i *)(r - 4), _mm_shuffle_epi32(a, 0x1b));
+
+        l += 4;
+        r -= 4;
+    }
+
+    generic_reverse(l, r - l);
+}
+
+CPU_TARGET("sse2")
+static void sse2_rotate_90(uint32_t *dst, const uint32_t *src, uint32_t width, uint32_t height)
+{
+    uint32_t i = 0;
+
+    /* transpose 4x4 blocks from 4 source rows at a time */
+    for (; i + 4 <= height; i += 4)
+    {
+        const uint32_t *s0 = src + (height - 1 - i) * width;
+        const uint32_t *s1 = s0 - width;
+        const uint32_t *s2 = s1 - width;
+        const uint32_t *s3 = s2 - width;
+        uint32_t j = 0;
+
+        for (; j + 4 <= width; j += 4)
+        {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(s0 + j));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(s1 + j));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(s2 + j));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(s3 + j));
+            __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+            __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+            __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+            uint32_t *d = dst + i + j * height;
+
+            _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128((__m128i *)(d + height), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128((__m128i *)(d + height * 2), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128((__m128i *)(d + height * 3), _mm_unpackhi_epi64(t2, t3));
+        }
+
+        for (; j < width; ++j)
+        {
+            uint32_t *d = dst + i + j * height;
+
+            d[0] = s0[j];
+            d[1] = s1[j];
+            d[2] = s2[j];
+            d[3] = s3[j];
+        }
+    }
+
+    cpu_rotate_rows(dst, src, width, height, i);
+}
+
+CPU_TARGET("sse2")
+static void sse2_pack(uint8_t *dst, const uint8_t *src, uint32_t size, uint8_t shift)
+{
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    uint32_t out = shift * 2;
+    uint32_t i = 0;
+
+    /* merge neighboring pairs until each byte holds 8 / shift indices */
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(src + i));
+        uint8_t tmp[16];
+
+        for (uint8_t s = shift; s < 8; s <<= 1)
+        {
+            __m128i first = _mm_sll_epi16(_mm_and_si128(chunk, low), _mm_cvtsi32_si128(s));
+            __m128i second = _mm_srli_epi16(chunk, 8);
+
+            chunk = _mm_and_si128(_mm_or_si128(first, second), low);
+            chunk = _mm_packus_epi16(chunk, chunk);
+        }
+
+        _mm_storeu_si128((__m128i *)tmp, chunk);
+        memcpy(dst, tmp, out);
+        dst += out;
+    }
+
+    generic_pack(dst, src + i, size - i, shift);
+}
+
+/* exact round(v / 255) for the biased products below */
+CPU_TARGET("sse2")
+static __m128i sse2_div255(__m128i v)
+{
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(v, _mm_set1_epi16(1)), _mm_srli_epi16(v, 8)), 8);
+}
+
+CPU_TARGET("sse2")
+static __m128i sse2_scale(__m128i c, short max)
+{
+    return sse2_div255(_mm_add_epi16(_mm_mullo_epi16(c, _mm_set1_epi16(max)), _mm_set1_epi16(127)));
+}
+
+CPU_TARGET("sse2")
+static bool sse2_convert_16(uint8_t *dst, const uint8_t *src, uint32_t nr_pixels, color_format_t fmt)
+{
+    const __m128i low = _mm_set1_epi32(0xff);
+    const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+    __m128i alpha = _mm_set1_epi32(-1);
+    uint32_t i = 0;
+    bool bad_alpha;
+
+    for (; i + 8 <= nr_pixels; i += 8)
+    {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(src + (i * 4)));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(src + (i * 4) + 16));
+        __m128i r = _mm_packs_epi32(_mm_and_si128(p0, low),
+                                    _mm_and_si128(p1, low));
+        __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), low),
+                                    _mm_and_si128(_mm_srli_epi32(p1, 8), low));
+        __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), low),
+                                    _mm_and_si128(_mm_srli_epi32(p1, 16), low));
+        __m128i r5 = sse2_scale(r, 31);
+        __m128i g6 = sse2_scale(g, 63);
+        __m128i b5 = sse2_scale(b, 31);
+        __m128i target;
+
+        alpha = _mm_and_si128(alpha, _mm_cmpeq_epi32(_mm_and_si128(p0, opaque), opaque));
+        alpha = _mm_and_si128(alpha, _mm_cmpeq_epi32(_mm_and_si128(p1, opaque), opaque));
+
+        switch (fmt)
+        {
+            case COLOR_1555_GRGB:
+                target = _mm_or_si128(
+                    _mm_or_si128(_mm_slli_epi16(g6, 15), _mm_slli_epi16(r5, 10)),
+                    _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(g6, 1), 5), b5));
+                break;
+
+            case COLOR_565_BGR:
+                target = _mm_or_si128(
+                    _mm_or_si128(_mm_slli_epi16(b5, 11), _mm_slli_epi16(g6, 5)), r5);
+                break;
+
+            default:
+            case COLOR_565_RGB:
+                target = _mm_or_si128(
+                    _mm_or_si128(_mm_slli_epi16(r5, 11), _mm_slli_epi16(g6, 5)), b5);
+                break;
+        }
+
+        _mm_storeu_si128((__m128i *)(dst + (i * 2)), target);
+    }
+
+    bad_alpha = _mm_movemask_epi8(alpha) != 0xffff;
+
+    return generic_convert_16(dst + (i * 2), src + (i * 4), nr_pixels - i, fmt) || bad_alpha;
+}
+
+CPU_TARGET("ssse3")
+static uint32_t ssse3_compact(uint8_t *data, uint32_t size, const uint32_t *mask)
+{
+    uint8_t lo_table[16];
+    uint8_t hi_table[16];
+    uint32_t i = 0;
+    uint32_t n = 0;
+
+    cpu_compact_tables(mask, lo_table, hi_table);
+
+    const __m128i lo_lut = _mm_loadu_si128((const __m128i *)lo_table);
+    const __m128i hi_lut = _mm_loadu_si128((const __m128i *)hi_table);
+    const __m128i bit_lut = _mm_loadu_si128((const __m128i *)cpu_bit_table);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i seven = _mm_set1_epi8(7);
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i lo = _mm_and_si128(chunk, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble);
+        __m128i upper = _mm_cmpgt_epi8(hi, seven);
+        __m128i row = _mm_or_si128(
+            _mm_and_si128(upper, _mm_shuffle_epi8(hi_lut, lo)),
+            _mm_andnot_si128(upper, _mm_shuffle_epi8(lo_lut, lo)));
+        __m128i bit = _mm_shuffle_epi8(bit_lut, hi);
+        uint32_t omit = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, bit), bit));
+
+        if (omit == 0)
+        {
+            /* n <= i, so this only overwrites bytes already loaded */
+            _mm_storeu_si128((__m128i *)(data + n), chunk);
+            n += 16;
+        }
+        else if (omit != 0xffff)
+        {
+            uint8_t tmp[16];
+
+            _mm_storeu_si128((__m128i *)tmp, chunk);
+
+            for (uint32_t j = 0; j < 16; ++j)
+            {
+                data[n] = tmp[j];
+                n += !((omit >> j) & 1);
+            }
+        }
+    }
+
+    return cpu_compact_tail(data, i, n, size, mask);
+}
+
+CPU_TARGET("avx2")
+static uint32_t avx2_span_equal(const uint8_t *data, uint32_t len, uint8_t value)
+{
+    const __m256i match = _mm256_set1_epi8((char)value);
+    uint32_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, match));
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + sse2_span_equal(data + i, len - i, value);
+}
+
+CPU_TARGET("avx2")
+static uint32_t avx2_compact(uint8_t *data, uint32_t size, const uint32_t *mask)
+{
+    uint8_t lo_table[16];
+    uint8_t hi_table[16];
+    uint32_t i = 0;
+    uint32_t n = 0;
+
+    cpu_compact_tables(mask, lo_table, hi_table);
+
+    /* pshufb works per 128-bit lane, so repeat the tables in both */
+    const __m256i lo_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo_table));
+    const __m256i hi_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi_table));
+    const __m256i bit_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cpu_bit_table));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i seven = _mm256_set1_epi8(7);
+
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i lo = _mm256_and_si256(chunk, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble);
+        __m256i upper = _mm256_cmpgt_epi8(hi, seven);
+        __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(lo_lut, lo),
+                                         _mm256_shuffle_epi8(hi_lut, lo),
+                                         upper);
+        __m256i bit = _mm256_shuffle_epi8(bit_lut, hi);
+        uint32_t omit = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit));
+
+        if (omit == 0)
+        {
+            /* n <= i, so this only overwrites bytes already loaded */
+            _mm256_storeu_si256((__m256i *)(data + n), chunk);
+            n += 32;
+        }
+        else if (omit != 0xffffffff)
+        {
+            uint8_t tmp[32];
+
+            _mm256_storeu_si256((__m256i *)tmp, chunk);
+
+            for (uint32_t j = 0; j < 32; ++j)
+            {
+                data[n] = tmp[j];
+                n += !((omit >> j) & 1);
+            }
+        }
+    }
+
+    return cpu_compact_tail(data, i, n, size, mask);
+}
+
+CPU_TARGET("avx2")
+static bool avx2_clamp_alpha(uint8_t *data, uint32_t nr_pixels)
+{
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i diff = zero;
+    uint32_t i = 0;
+    bool changed;
+
+    for (; i + 8 <= nr_pixels; i += 8)
+    {
+        __m256i *ptr = (__m256i *)(data + (i * 4));
+        __m256i pixels = _mm256_loadu_si256(ptr);
+        __m256i rounded = _mm256_blendv_epi8(pixels,
+                                             _mm256_cmpgt_epi8(zero, pixels),
+                                             alpha);
+
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(pixels, rounded));
+        _mm256_storeu_si256(ptr, rounded);
+    }
+
+    changed = !_mm256_testz_si256(diff, diff);
+
+    return sse2_clamp_alpha(data + (i * 4), nr_pixels - i) || changed;
+}
+
+CPU_TARGET("avx2")
+static void avx2_reverse(uint32_t *data, uint32_t count)
+{
+    const __m256i order = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    uint32_t *l = data;
+    uint32_t *r = data + count;
+
+    while (r - l >= 16)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)l);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(r - 8));
+
+        _mm256_storeu_si256((__m256i *)l, _mm256_permutevar8x32_epi32(b, order));
+        _mm256_storeu_si256((__m256i *)(r - 8), _mm256_permutevar8x32_epi32(a, order));
+
+        l += 8;
+        r -= 8;
+    }
+
+    sse2_reverse(l, r - l);
+}
+
+CPU_TARGET("avx2")
+static __m256i avx2_scale(__m256i c, short max)
+{
+    __m256i v = _mm256_add_epi16(_mm256_mullo_epi16(c, _mm256_set1_epi16(max)), _mm256_set1_epi16(127));
+
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(v, _mm256_set1_epi16(1)), _mm256_srli_epi16(v, 8)), 8);
+}
+
+/* packs the low 16 bits of each 32-bit lane, restoring pixel order */
+CPU_TARGET("avx2")
+static __m256i avx2_pack_channel(__m256i p0, __m256i p1, int shift)
+{
+    const __m256i low = _mm256_set1_epi32(0xff);
+    __m256i c0 = _mm256_and_si256(_mm256_srl_epi32(p0, _mm_cvtsi32_si128(shift)), low);
+    __m256i c1 = _mm256_and_si256(_mm256_srl_epi32(p1, _mm_cvtsi32_si128(shift)), low);
+
+    return _mm256_permute4x64_epi64(_mm256_packs_epi32(c0, c1), 0xd8);
+}
+
+CPU_TARGET("avx2")
+static bool avx2_convert_16(uint8_t *dst, const uint8_t *src, uint32_t nr_pixels, color_format_t fmt)
+{
+    const __m256i opaque = _mm256_set1_epi32((int)0xff000000);
+    __m256i alpha = _mm256_set1_epi32(-1);
+    uint32_t i = 0;
+    bool bad_alpha;
+
+    for (; i + 16 <= nr_pixels; i += 16)
+    {
+        __m256i p0 = _mm256_loadu_si256((const __m256i *)(src + (i * 4)));
+        __m256i p1 = _mm256_loadu_si256((const __m256i *)(src + (i * 4) + 32));
+        __m256i r5 = avx2_scale(avx2_pack_channel(p0, p1, 0), 31);
+        __m256i g6 = avx2_scale(avx2_pack_channel(p0, p1, 8), 63);
+        __m256i b5 = avx2_scale(avx2_pack_channel(p0, p1, 16), 31);
+        __m256i target;
+
+        alpha = _mm256_and_si256(alpha, _mm256_cmpeq_epi32(_mm256_and_si256(p0, opaque), opaque));
+        alpha = _mm256_and_si256(alpha, _mm256_cmpeq_epi32(_mm256_and_si256(p1, opaque), opaque));
+
+        switch (fmt)
+        {
+            case COLOR_1555_GRGB:
+                target = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_slli_epi16(g6, 15), _mm256_slli_epi16(r5, 10)),
+                    _mm256_or_si256(_mm256_slli_epi16(_mm256_srli_epi16(g6, 1), 5), b5));
+                break;
+
+            case COLOR_565_BGR:
+                target = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_slli_epi16(b5, 11), _mm256_slli_epi16(g6, 5)), r5);
+                break;
+
+            default:
+            case COLOR_565_RGB:
+                target = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_slli_epi16(r5, 11), _mm256_slli_epi16(g6, 5)), b5);
+                break;
+        }
+
+        _mm256_storeu_si256((__m256i *)(dst + (i * 2)), target);
+    }
+
+    bad_alpha = (uint32_t)_mm256_movemask_epi8(alpha) != 0xffffffff;
+
+    return sse2_convert_16(dst + (i * 2), src + (i * 4), nr_pixels - i, fmt) || bad_alpha;
+}
+
+#endif
+
+#if defined(CPU_NEON)
+
+static uint8_t neon_min(uint8x16_t v)
+{
+    uint8x8_t m = vpmin_u8(vget_low_u8(v), vget_high_u8(v));
+
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+
+    return vget_lane_u8(m, 0);
+}
+
+static uint8_t neon_max(uint8x16_t v)
+{
+    uint8x8_t m = vpmax_u8(vget_low_u8(v), vget_high_u8(v));
+
+    m = vpmax_u8(m, m);
+    m = vpmax_u8(m, m);
+    m = vpmax_u8(m, m);
+
+    return vget_lane_u8(m, 0);
+}
+
+static uint32_t neon_span_equal(const uint8_t *data, uint32_t len, uint8_t value)
+{
+    const uint8x16_t match = vdupq_n_u8(value);
+    uint32_t i = 0;
+
+    /* skip whole matching chunks, the scalar loop finds the exact end */
+    for (; i + 16 <= len; i += 16)
+    {
+        if (neon_min(vceqq_u8(vld1q_u8(data + i), match)) != 0xff)
+        {
+            break;
+        }
+    }
+
+    return i + generic_span_equal(data + i, len - i, value);
+}
+
+static bool neon_clamp_alpha(uint8_t *data, uint32_t nr_pixels)
+{
+    const uint8x16_t alpha = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+    uint8x16_t diff = vdupq_n_u8(0);
+    uint32_t i = 0;
+    bool changed;
+
+    for (; i + 4 <= nr_pixels; i += 4)
+    {
+        uint8_t *ptr = data + (i * 4);
+        uint8x16_t pixels = vld1q_u8(ptr);
+
+        /* arithmetic shift spreads the top bit, giving 255 or 0 */
+        uint8x16_t high = vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(pixels), 7));
+        uint8x16_t rounded = vbslq_u8(alpha, high, pixels);
+
+        diff = vorrq_u8(diff, veorq_u8(pixels, rounded));
+        vst1q_u8(ptr, rounded);
+    }
+
+    changed = neon_max(diff) != 0;
+
+    return generic_clamp_alpha(data + (i * 4), nr_pixels - i) || changed;
+}
+
+static void neon_reverse(uint32_t *data, uint32_t count)
+{
+    uint32_t *l = data;
+    uint32_t *r = data + count;
+
+    while (r - l >= 8)
+    {
+        uint32x4_t a = vrev64q_u32(vld1q_u32(l));
+        uint32x4_t b = vrev64q_u32(vld1q_u32(r - 4));
+
+        vst1q_u32(l, vcombine_u32(vget_high_u32(b), vget_low_u32(b)));
+        vst1q_u32(r - 4, vcombine_u32(vget_high_u32(a), vget_low_u32(a)));
+
+        l += 4;
+        r -= 4;
+    }
+
+    generic_reverse(l, r - l);
+}
+
+#endif
+
+static const struct cpu_kernels cpu_generic_kernels =
+{
+    .span_equal = generic_span_equal,
+    .compact = generic_compact,
+    .clamp_alpha = generic_clamp_alpha,
+    .reverse = generic_reverse,
+    .rotate_90 = generic_rotate_90,
+    .pack = generic_pack,
+    .convert_16 = generic_convert_16,
+};
+
+/* usable before cpu_init, e.g. by icon conversion */
+struct cpu_kernels cpu_kernels =
+{
+    .span_equal = generic_span_equal,
+    .compact = generic_compact,
+    .clamp_alpha = generic_clamp_alpha,
+    .reverse = generic_reverse,
+    .rotate_90 = generic_rotate_90,
+    .pack = generic_pack,
+    .convert_16 = generic_convert_16,
+};
+
+static cpu_level_t cpu_detect(void)
+{
+#if defined(CPU_X86)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return CPU_LEVEL_AVX2;
+    }
+
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        return CPU_LEVEL_SSSE3;
+    }
+
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return CPU_LEVEL_SSE2;
+    }
+#elif defined(CPU_NEON)
+#if defined(__aarch64__)
+    return CPU_LEVEL_NEON;
+#elif defined(__linux__)
+    if (getauxval(AT_HWCAP) & HWCAP_NEON)
+    {
+        return CPU_LEVEL_NEON;
+    }
+#endif
+#endif
+
+    return CPU_LEVEL_GENERIC;
+}
+
+static bool cpu_level_supported(cpu_level_t level, cpu_level_t detected)
+{
+    if (level == CPU_LEVEL_GENERIC || level == detected)
+    {
+        return true;
+    }
+
+    /* each x86 level includes the ones below it */
+    return level < detected &&
+           level != CPU_LEVEL_NEON &&
+           detected != CPU_LEVEL_NEON;
+}
+
+static void cpu_select(cpu_level_t level)
+{
+    cpu_kernels = cpu_generic_kernels;
+
+#if defined(CPU_X86)
+    if (level >= CPU_LEVEL_SSE2 && level <= CPU_LEVEL_AVX2)
+    {
+        cpu_kernels.span_equal = sse2_span_equal;
+        cpu_kernels.clamp_alpha = sse2_clamp_alpha;
+        cpu_kernels.reverse = sse2_reverse;
+        cpu_kernels.rotate_90 = sse2_rotate_90;
+        cpu_kernels.pack = sse2_pack;
+        cpu_kernels.convert_16 = sse2_convert_16;
+    }
+
+    if (level >= CPU_LEVEL_SSSE3 && level <= CPU_LEVEL_AVX2)
+    {
+        cpu_kernels.compact = ssse3_compact;
+    }
+
+    if (level == CPU_LEVEL_AVX2)
+    {
+        cpu_kernels.span_equal = avx2_span_equal;
+        cpu_kernels.compact = avx2_compact;
+        cpu_kernels.clamp_alpha = avx2_clamp_alpha;
+        cpu_kernels.reverse = avx2_reverse;
+        cpu_kernels.convert_16 = avx2_convert_16;
+    }
+#endif
+
+#if defined(CPU_NEON)
+    if (level == CPU_LEVEL_NEON)
+    {
+        cpu_kernels.span_equal = neon_span_equal;
+        cpu_kernels.clamp_alpha = neon_clamp_alpha;
+        cpu_kernels.reverse = neon_reverse;
+    }
+#endif
+}
+
+int cpu_init(const char *level)
+{
+    cpu_level_t detected = cpu_detect();
+    cpu_level_t selected = detected;
+
+    if (level != NULL && strcmp(level, "auto"))
+    {
+        uint32_t i;
+
+        for (i = 0; i < sizeof cpu_level_names / sizeof cpu_level_names[0]; ++i)
+        {
+            if (!strcmp(level, cpu_level_names[i]))
+            {
+                break;
+            }
+        }
+
+        if (i == sizeof cpu_level_names / sizeof cpu_level_names[0])
+        {
+            LOG_ERROR("Unknown CPU level \'%s\'.\n", level);
+            return -1;
+        }
+
+        selected = (cpu_level_t)i;
+
+        if (!cpu_level_supported(selected, detected))
+        {
+            LOG_ERROR("CPU level \'%s\' is not supported by this machine (max \'%s\').\n",
+                level, cpu_level_names[detected]);
+            return -1;
+        }
+    }
+
+    cpu_select(selected);
+
+    LOG_DEBUG("Using \'%s\' pixel kernels.\n", cpu_level_names[selected]);
+
+    return 0;
+}
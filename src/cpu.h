@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017-2026 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef CPU_H
+#define CPU_H
+
+#include "color.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    CPU_LEVEL_GENERIC,
+    CPU_LEVEL_SSE2,
+    CPU_LEVEL_SSSE3,
+    CPU_LEVEL_AVX2,
+    CPU_LEVEL_NEON,
+} cpu_level_t;
+
+struct cpu_kernels
+{
+    /* length of the leading run of bytes equal to value */
+    uint32_t (*span_equal)(const uint8_t *data, uint32_t len, uint8_t value);
+
+    /* removes bytes set in a 256-bit mask in place, returns the new size */
+    uint32_t (*compact)(uint8_t *data, uint32_t size, const uint32_t *mask);
+
+    /* rounds alpha to 0 or 255, returns true if any pixel changed */
+    bool (*clamp_alpha)(uint8_t *data, uint32_t nr_pixels);
+
+    /* reverses the order of count pixels in place */
+    void (*reverse)(uint32_t *data, uint32_t count);
+
+    /* rotates src clockwise by 90 degrees into dst */
+    void (*rotate_90)(uint32_t *dst, const uint32_t *src, uint32_t width, uint32_t height);
+
+    /* packs 8 / shift indices per byte, size is a multiple of 8 / shift */
+    void (*pack)(uint8_t *dst, const uint8_t *src, uint32_t size, uint8_t shift);
+
+    /* converts rgba pixels to a 16-bit format, returns true if any alpha != 255 */
+    bool (*convert_16)(uint8_t *dst, const uint8_t *src, uint32_t nr_pixels, color_format_t fmt);
+};
+
+extern struct cpu_kernels cpu_kernels;
+
+int cpu_init(const char *level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
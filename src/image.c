@@ -30,6 +30,7 @@
 
 #include "image.h"
 #include "palette.h"
+#include "cpu.h"
 #include "strings.h"
 #include "memory.h"
 #include "log.h"
@@ -39,35 +40,30 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "deps/stb/stb_image.h"
 
-static void swap_pixel(uint32_t *a, uint32_t *b)
-{
-    uint32_t temp = *a;
-    *a = *b;
-    *b = temp;
-}
+#include <string.h>
+#include <limits.h>
 
 void image_flip_y(uint32_t *data, uint32_t width, uint32_t height)
 {
     for (uint32_t r = 0; r < height; ++r)
     {
-        uint32_t *row = data + (r * width);
-
-        for (uint32_t c = 0; c < width / 2; ++c)
-        {
-            swap_pixel(row + c,
-                       row + width - c - 1);
-        }
+        cpu_kernels.reverse(data + (r * width), width);
     }
 }
 
 void image_flip_x(uint32_t *data, uint32_t width, uint32_t height)
 {
-    for (uint32_t c = 0; c < width; ++c)
+    /* swap whole rows so both sides are walked sequentially */
+    for (uint32_t r = 0; r < height / 2; ++r)
     {
-        for (uint32_t r = 0; r < height / 2; ++r)
+        uint32_t *top = data + (r * width);
+        uint32_t *bottom = data + (height - 1 - r) * width;
+
+        for (uint32_t c = 0; c < width; ++c)
         {
-            swap_pixel(data + (r * width) + c,
-                       data + (height - 1 - r) * width + c);
+            uint32_t temp = top[c];
+            top[c] = bottom[c];
+            bottom[c] = temp;
         }
     }
 }
@@ -78,24 +74,16 @@ int image_rotate_90(uint32_t *data, uint32_t width, uint32_t height)
     uint32_t data_size;
 
     data_size = width * height * 4;
-    new_data = memory_alloc(data_size);
+    new_data = memory_arena_alloc(data_size);
     if (new_data == NULL)
     {
         return -1;
     }
 
-    for(uint32_t i = 0; i < height; ++i)
-    {
-        uint32_t o = (height - 1 - i) * width;
-
-        for(uint32_t j = 0; j < width; ++j)
-        {
-            new_data[i + j * height] = data[o + j];
-        }
-    }
+    cpu_kernels.rotate_90(new_data, data, width, height);
 
     memcpy(data, new_data, data_size);
-    free(new_data);
+    memory_arena_free(new_data);
 
     return 0;
 }
@@ -109,6 +97,11 @@ void image_init(struct image *image, const char *path)
     image->data_size = 0;
     image->width = 0;
     image->height = 0;
+    image->map.handle = NULL;
+    image->sheet = NULL;
+    image->sheet_x = 0;
+    image->sheet_y = 0;
+    image->stride = 0;
 
     /* set by convert */
     image->quantize_speed = 1;
@@ -118,41 +111,43 @@ void image_init(struct image *image, const char *path)
     image->flip_x = false;
     image->flip_y = false;
     image->compressed = false;
+    image->compression = COMPRESS_NONE;
+    image->stored = false;
     image->uncompressed_size = 0;
+    image->decompress_delta = 0;
+    image->converted_size = 0;
+    image->quantize_time = 0;
+    memset(&image->compress_stats, 0, sizeof image->compress_stats);
     image->transparent_index = 0;
+    image->converted = false;
+    image->nr_pending_outputs = 0;
 }
 
-int image_load(struct image *image)
+/* maps the input file once for every reader */
+static int image_map(struct image *image)
 {
-    uint32_t *data;
-    uint32_t width;
-    uint32_t height;
-    int w;
-    int h;
-    int c;
-
-    data = (uint32_t *)stbi_load(image->path,
-                                 &w, &h, &c,
-                                 STBI_rgb_alpha);
-    if (data == NULL)
+    if (image->map.handle != NULL)
     {
-        LOG_ERROR("Could not load image \'%s\'.\n", image->path);
-        goto error;
+        return 0;
     }
 
-    if (w <= 0 || h <= 0 || w > STBI_MAX_DIMENSIONS || h > STBI_MAX_DIMENSIONS)
+    if (file_map_open(&image->map, image->path))
     {
-        LOG_ERROR("Image \'%s\' is too large.\n", image->path);
-        goto error;
+        return -1;
     }
 
-    /* library output is int, convert to unsigned */
-    width = w;
-    height = h;
+    if (image->map.size > INT_MAX)
+    {
+        file_map_close(&image->map);
+        return -1;
+    }
 
-    /* converted nothing, so no data size yet */
-    image->data_size = 0;
+    return 0;
+}
 
+/* applies flips and rotation, then assigns the pixels to the image */
+int image_orient(struct image *image, uint32_t *data, uint32_t width, uint32_t height)
+{
     if (image->flip_x)
     {
         image_flip_x(data, width, height);
@@ -168,12 +163,11 @@ int image_load(struct image *image)
         default:
             LOG_ERROR("Invalid image rotation \'%u\'.\n",
                 image->rotate);
-            goto error;
+            return -1;
 
         case 0:
             image->width = width;
             image->height = height;
-            image->data = (uint8_t *)data;
             break;
 
         case 90:
@@ -181,9 +175,8 @@ int image_load(struct image *image)
             image->height = width;
             if (image_rotate_90(data, width, height))
             {
-                goto error;
+                return -1;
             }
-            image->data = (uint8_t *)data;
             break;
 
         case 180:
@@ -191,7 +184,6 @@ int image_load(struct image *image)
             image->height = height;
             image_flip_y(data, width, height);
             image_flip_x(data, width, height);
-            image->data = (uint8_t *)data;
             break;
 
         case 270:
@@ -199,14 +191,60 @@ int image_load(struct image *image)
             image->height = width;
             if (image_rotate_90(data, width, height))
             {
-                goto error;
+                return -1;
             }
             image_flip_y(data, width, height);
             image_flip_x(data, width, height);
-            image->data = (uint8_t *)data;
             break;
     }
 
+    image->data = (uint8_t *)data;
+
+    return 0;
+}
+
+int image_load(struct image *image)
+{
+    uint32_t *data;
+    int w;
+    int h;
+    int c;
+
+    if (image_map(image))
+    {
+        LOG_ERROR("Could not load image \'%s\'.\n", image->path);
+        return -1;
+    }
+
+    data = (uint32_t *)stbi_load_from_memory(image->map.data,
+                                             (int)image->map.size,
+                                             &w, &h, &c,
+                                             STBI_rgb_alpha);
+
+    /* the encoded bytes are not needed after decoding */
+    file_map_close(&image->map);
+
+    if (data == NULL)
+    {
+        LOG_ERROR("Could not load image \'%s\'.\n", image->path);
+        goto error;
+    }
+
+    if (w <= 0 || h <= 0 || w > STBI_MAX_DIMENSIONS || h > STBI_MAX_DIMENSIONS)
+    {
+        LOG_ERROR("Image \'%s\' is too large.\n", image->path);
+        goto error;
+    }
+
+    /* converted nothing, so no data size yet */
+    image->data_size = 0;
+
+    /* library output is int, convert to unsigned */
+    if (image_orient(image, data, w, h))
+    {
+        goto error;
+    }
+
     return 0;
 
 error:
@@ -214,6 +252,45 @@ error:
     return -1;
 }
 
+void image_prefetch(struct image *image)
+{
+    /* sprites read the pixels of their decoded sheet */
+    if (image->sheet != NULL)
+    {
+        return;
+    }
+
+    /* a failure here is reported by the load */
+    if (!image_map(image))
+    {
+        file_map_prefetch(&image->map);
+    }
+}
+
+int image_probe(struct image *image, uint32_t *width, uint32_t *height)
+{
+    int w;
+    int h;
+    int c;
+
+    if (image_map(image))
+    {
+        return -1;
+    }
+
+    /* reads only the header, the mapping is kept for decoding */
+    if (!stbi_info_from_memory(image->map.data, (int)image->map.size, &w, &h, &c) ||
+        w <= 0 || h <= 0)
+    {
+        return -1;
+    }
+
+    *width = w;
+    *height = h;
+
+    return 0;
+}
+
 void image_free(struct image *image)
 {
     if (image == NULL)
@@ -223,244 +300,323 @@ void image_free(struct image *image)
 
     free(image->name);
     free(image->path);
-    free(image->data);
+    if (image->stride == 0)
+    {
+        free(image->data);
+    }
+    file_map_close(&image->map);
 }
 
-int image_add_width_and_height(struct image *image, bool swap)
+/* writes the width and height prefix if requested, returns its size */
+static uint32_t image_write_width_and_height(const struct image *image,
+                                             const struct image_stages *stages,
+                                             uint8_t *data)
 {
-    image->data = memory_realloc(image->data, image->data_size + WIDTH_HEIGHT_SIZE);
-    if (image->data == NULL)
+    if (!stages->width_and_height)
     {
-        return -1;
+        return 0;
     }
 
-    memmove(image->data + WIDTH_HEIGHT_SIZE, image->data, image->data_size);
-
-    if (!swap)
+    if (!stages->swap_width_height)
     {
-        image->data[0] = image->width;
-        image->data[1] = image->height;
+        data[0] = image->width;
+        data[1] = image->height;
     }
     else
     {
-        image->data[0] = image->height;
-        image->data[1] = image->width;
+        data[0] = image->height;
+        data[1] = image->width;
     }
 
-    image->data_size += WIDTH_HEIGHT_SIZE;
-
-    return 0;
+    return WIDTH_HEIGHT_SIZE;
 }
 
-int image_rlet(struct image *image, uint8_t transparent_index)
+/* length of the leading run of bytes not equal to value */
+static uint32_t image_rlet_span_not_equal(const uint8_t *data, uint32_t len, uint8_t value)
 {
-    uint8_t *new_data;
-    uint32_t new_size;
+    const uint8_t *found = memchr(data, value, len);
 
-    /* multiply by 3 for worst-case encoding */
-    new_size = image->width * image->height * 3;
-    new_data = memory_alloc(new_size);
-    if (new_data == NULL)
-    {
-        return -1;
-    }
+    return found == NULL ? len : (uint32_t)(found - data);
+}
 
-    new_size = 0;
+/* encodes into out if not NULL, returns the encoded size */
+static uint32_t image_rlet_encode(const uint8_t *data,
+                                  uint32_t width,
+                                  uint32_t height,
+                                  uint8_t transparent_index,
+                                  uint8_t *out)
+{
+    uint32_t size = 0;
 
-    for (uint32_t i = 0; i < image->height; i++)
+    for (uint32_t i = 0; i < height; ++i)
     {
-        uint32_t offset = i * image->width;
-        uint32_t left = image->width;
+        const uint8_t *row = data + (i * width);
+        uint32_t left = width;
 
         while (left)
         {
-            uint32_t o;
             uint32_t t;
+            uint32_t o;
 
-            t = o = 0;
-            while (t < left && transparent_index == image->data[t + offset])
+            t = cpu_kernels.span_equal(row, left, transparent_index);
+            if (out != NULL)
             {
-                t++;
+                out[size] = t;
             }
+            size++;
 
-            new_data[new_size] = t;
-            new_size++;
+            row += t;
+            left -= t;
+            if (left == 0)
+            {
+                break;
+            }
 
-            if ((left -= t))
+            o = image_rlet_span_not_equal(row, left, transparent_index);
+            if (out != NULL)
             {
-                uint8_t *opaque_len = &new_data[new_size];
-                new_size++;
-
-                while (o < left && transparent_index != image->data[t + o + offset])
-                {
-                    new_data[new_size] = image->data[t + o + offset];
-                    new_size++;
-                    o++;
-                }
-
-                *opaque_len = o;
-                left -= o;
+                out[size] = o;
+                memcpy(&out[size + 1], row, o);
             }
+            size += o + 1;
 
-            offset += o + t;
+            row += o;
+            left -= o;
         }
     }
 
-    free(image->data);
-    image->data = new_data;
-    image->data_size = new_size;
+    return size;
+}
 
-    return 0;
+static uint32_t image_count_kept(const uint8_t *data, uint32_t size, const uint32_t *omit_mask)
+{
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        n += !((omit_mask[data[i] >> 5] >> (data[i] & 31)) & 1);
+    }
+
+    return n;
 }
 
-int image_set_bpp(struct image *image, bpp_t bpp, uint32_t nr_palette_entries)
+static void image_offset_row(uint8_t *row, uint32_t width, uint8_t offset)
 {
+    if (offset == 0)
+    {
+        return;
+    }
+
+    for (uint32_t j = 0; j < width; ++j)
+    {
+        row[j] += offset;
+    }
+}
+
+/* runs rlet, omits, and bpp packing on one row */
+/* writes into out if not NULL, returns the output size */
+static uint32_t image_stage_row(const struct image_stages *stages,
+                                const uint32_t *omit_mask,
+                                uint8_t shift,
+                                const uint8_t *row,
+                                uint32_t width,
+                                uint8_t *scratch,
+                                uint8_t *out)
+{
+    const uint8_t *src = row;
+    uint32_t size = width;
+
+    if (stages->rlet)
+    {
+        if (omit_mask == NULL)
+        {
+            return image_rlet_encode(row, width, 1, stages->transparent_index, out);
+        }
+
+        size = image_rlet_encode(row, width, 1, stages->transparent_index, scratch);
+        src = scratch;
+    }
+
+    if (omit_mask != NULL)
+    {
+        if (out == NULL)
+        {
+            return image_count_kept(src, size, omit_mask);
+        }
+
+        /* out is sized exactly, so compact in scratch first */
+        if (src != scratch)
+        {
+            memcpy(scratch, src, size);
+        }
+
+        size = cpu_kernels.compact(scratch, size, omit_mask);
+        memcpy(out, scratch, size);
+
+        return size;
+    }
+
+    if (shift == 8)
+    {
+        if (out != NULL)
+        {
+            memcpy(out, src, size);
+        }
+
+        return size;
+    }
+
+    if (out != NULL)
+    {
+        cpu_kernels.pack(out, src, size, shift);
+    }
+
+    return size / (8 / shift);
+}
+
+int image_apply_stages(struct image *image, const struct image_stages *stages)
+{
+    uint32_t omit_mask[PALETTE_MAX_ENTRIES / 32];
+    const uint32_t *mask = NULL;
+    uint8_t *scratch = NULL;
     uint8_t *new_data;
+    uint8_t *dst;
     uint32_t new_size;
-    uint8_t shift_mult;
-    uint8_t inc;
+    uint8_t shift;
+    bool offset_done;
 
-    switch (bpp)
+    switch (stages->bpp)
     {
         case BPP_1:
-            if (nr_palette_entries > 2)
+            if (stages->nr_palette_entries > 2)
             {
                 LOG_ERROR("Palette has too many entries for BPP mode. (max 2)\n");
-                return -1;
+                goto error;
             }
-            shift_mult = 1;
-            inc = 8;
+            shift = 1;
             break;
 
         case BPP_2:
-            if (nr_palette_entries > 4)
+            if (stages->nr_palette_entries > 4)
             {
                 LOG_ERROR("Palette has too many entries for BPP mode. (max 4)\n");
-                return -1;
+                goto error;
             }
-            shift_mult = 2;
-            inc = 4;
+            shift = 2;
             break;
 
         case BPP_4:
-            if (nr_palette_entries > 16)
+            if (stages->nr_palette_entries > 16)
             {
                 LOG_ERROR("Palette has too many entries for BPP mode. (max 16)\n");
-                return -1;
+                goto error;
             }
-            shift_mult = 4;
-            inc = 2;
+            shift = 4;
             break;
 
         case BPP_8:
-            return 0;
+            shift = 8;
+            break;
 
         default:
             LOG_ERROR("Invalid BPP mode.\n");
-            return -1;
+            goto error;
     }
 
     /* if not a multiple of the bit width, reject the image */
-    if (image->width % inc)
-    {
-        LOG_ERROR("Image width is not a multiple of the BPP (needs to be multiple of %d).\n", inc);
-        return -1;
-    }
-
-    new_data = memory_realloc_array(NULL, image->width, image->height);
-    if (new_data == NULL)
+    if (image->width % (8 / shift))
     {
-        return -1;
+        LOG_ERROR("Image width is not a multiple of the BPP (needs to be multiple of %d).\n", 8 / shift);
+        goto error;
     }
 
-    new_size = 0;
-
-    for (uint32_t j = 0; j < image->height; ++j)
+    if (stages->nr_omit_indices)
     {
-        uint32_t offset = j * image->width;
+        memset(omit_mask, 0, sizeof omit_mask);
 
-        for (uint32_t k = 0; k < image->width; k += inc)
+        for (uint32_t i = 0; i < stages->nr_omit_indices; ++i)
         {
-            uint8_t cur_inc = inc;
-            uint8_t col;
-            uint8_t byte = 0;
+            omit_mask[stages->omit_indices[i] >> 5] |= 1u << (stages->omit_indices[i] & 31);
+        }
 
-            for (col = 0; col < inc; col++)
-            {
-                byte |= image->data[k + offset + col] << (--cur_inc * shift_mult);
-            }
+        mask = omit_mask;
+    }
 
-            new_data[new_size] = byte;
-            new_size++;
+    if (mask != NULL)
+    {
+        /* an rlet row never exceeds 2 * width + 1 bytes */
+        scratch = memory_arena_alloc((image->width * 2) + 1);
+        if (scratch == NULL)
+        {
+            goto error;
         }
     }
 
-    free(image->data);
-    image->data = new_data;
-    image->data_size = new_size;
+    new_size = stages->width_and_height ? WIDTH_HEIGHT_SIZE : 0;
+    offset_done = false;
 
-    return 0;
-}
-
-int image_add_offset(struct image *image, uint8_t offset)
-{
-    for (uint32_t i = 0; i < image->data_size; ++i)
+    /* variable length rows need a sizing pass, which also adds the offset */
+    if (stages->rlet || mask != NULL)
     {
-        image->data[i] += offset;
-    }
+        for (uint32_t i = 0; i < image->height; ++i)
+        {
+            uint8_t *row = image->data + (i * image->width);
 
-    return 0;
-}
+            image_offset_row(row, image->width, stages->offset);
 
-int image_remove_omits(struct image *image, const uint8_t *omit_indices, uint32_t nr_omit_indices)
-{
-    uint8_t *new_data;
-    uint32_t new_size;
+            new_size += image_stage_row(stages, mask, shift, row, image->width, scratch, NULL);
+        }
 
-    if (nr_omit_indices == 0)
+        offset_done = true;
+    }
+    else
     {
-        return 0;
+        new_size += (image->width * image->height) / (8 / shift);
     }
 
-    new_size = 0;
-    new_data = memory_alloc(image->data_size);
+    new_data = memory_alloc(new_size);
     if (new_data == NULL)
     {
-        return -1;
+        goto error;
     }
 
-    for (uint32_t i = 0; i < image->data_size; ++i)
+    dst = new_data + image_write_width_and_height(image, stages, new_data);
+
+    for (uint32_t i = 0; i < image->height; ++i)
     {
-        for (uint32_t j = 0; j < nr_omit_indices; ++j)
+        uint8_t *row = image->data + (i * image->width);
+
+        if (!offset_done)
         {
-            if (image->data[i] == omit_indices[j])
-            {
-                goto nextbyte;
-            }
+            image_offset_row(row, image->width, stages->offset);
         }
 
-        new_data[new_size] = image->data[i];
-        new_size++;
-
-nextbyte:
-        continue;
+        dst += image_stage_row(stages, mask, shift, row, image->width, scratch, dst);
     }
 
-    free(image->data);
+    memory_arena_free(scratch);
+    memory_arena_free(image->data);
     image->data = new_data;
     image->data_size = new_size;
 
     return 0;
+
+error:
+    /* the input may be task memory, so it cannot outlive this call */
+    memory_arena_free(scratch);
+    memory_arena_free(image->data);
+    image->data = NULL;
+    return -1;
 }
 
-int image_compress(struct image *image, compress_mode_t mode)
+int image_compress(struct image *image, compress_mode_t mode, uint32_t min_gain, uint32_t tolerance)
 {
     if (mode != COMPRESS_NONE)
     {
         size_t size = image->data_size;
         void *original_data = image->data;
 
-        image->data = compress_array(original_data, &size, mode);
+        image->data = compress_array(original_data, &size, &mode, min_gain, tolerance, &image->compress_stats);
         free(original_data);
 
         if (image->data == NULL)
@@ -469,17 +625,41 @@ int image_compress(struct image *image, compress_mode_t mode)
         }
 
         image->data_size = size;
+        image->compression = mode;
+        image->decompress_delta = image->compress_stats.delta;
     }
 
     return 0;
 }
 
+/* buffer that holds the compressed data at its end and decompresses over it */
+uint32_t image_in_place_size(const struct image *image)
+{
+    uint32_t size = image->uncompressed_size + image->decompress_delta;
+
+    return size > image->data_size ? size : image->data_size;
+}
+
+/* sprite views borrow their pixels from the sheet */
+void image_release_pixels(struct image *image)
+{
+    if (image->stride == 0)
+    {
+        memory_arena_free(image->data);
+    }
+
+    image->data = NULL;
+    image->stride = 0;
+}
+
 int image_quantize(struct image *image, const struct palette *palette)
 {
     liq_image *liqimage = NULL;
     liq_result *liqresult = NULL;
     liq_attr *liqattr = NULL;
     uint8_t *new_data = NULL;
+    void **rows = NULL;
+    uint32_t pitch;
     uint32_t new_size;
     bool bad_alpha;
 
@@ -490,33 +670,52 @@ int image_quantize(struct image *image, const struct palette *palette)
         return -1;
     }
 
-    bad_alpha = false;
+    pitch = image->stride ? image->stride : image->width;
 
-    /* loop through each input pixel and round if transparent */
-    for (uint32_t i = 0; i < image->width * image->height; ++i)
+    if (image->stride == 0)
     {
-        uint8_t *a = &image->data[(i * 4) + 3];
+        /* round partially transparent pixels, sheets are rounded on load */
+        bad_alpha = cpu_kernels.clamp_alpha(image->data, image->width * image->height);
 
-        if (*a != 0 && *a != 255)
+        if (bad_alpha)
         {
-            *a = *a < 128 ? 0 : 255;
-            bad_alpha = true;
+            LOG_WARNING("Partially transparent pixels were rounded to fully transparent or fully opaque.\n");
+            LOG_WARNING("This may result in incorrect image conversion.\n");
         }
     }
 
-    if (bad_alpha)
+    liq_set_speed(liqattr, image->quantize_speed);
+    liq_set_max_colors(liqattr, palette->nr_entries);
+
+    if (image->stride == 0)
     {
-        LOG_WARNING("Partially transparent pixels were rounded to fully transparent or fully opaque.\n");
-        LOG_WARNING("This may result in incorrect image conversion.\n");
+        liqimage = liq_image_create_rgba(liqattr,
+                                         image->data,
+                                         image->width,
+                                         image->height,
+                                         0);
+    }
+    else
+    {
+        rows = memory_arena_alloc(image->height * sizeof(void *));
+        if (rows == NULL)
+        {
+            liq_attr_destroy(liqattr);
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < image->height; ++i)
+        {
+            rows[i] = image->data + (i * pitch * 4);
+        }
+
+        liqimage = liq_image_create_rgba_rows(liqattr,
+                                              rows,
+                                              image->width,
+                                              image->height,
+                                              0);
     }
 
-    liq_set_speed(liqattr, image->quantize_speed);
-    liq_set_max_colors(liqattr, palette->nr_entries);
-    liqimage = liq_image_create_rgba(liqattr,
-                                     image->data,
-                                     image->width,
-                                     image->height,
-                                     0);
     if (liqimage == NULL)
     {
         LOG_ERROR("Failed to create image \'%s\'\n", image->path);
@@ -551,7 +750,7 @@ int image_quantize(struct image *image, const struct palette *palette)
     liq_set_dithering_level(liqresult, image->dither);
 
     new_size = image->width * image->height;
-    new_data = memory_alloc(new_size);
+    new_data = memory_arena_alloc(new_size);
     if (new_data == NULL)
     {
         liq_result_destroy(liqresult);
@@ -565,7 +764,7 @@ int image_quantize(struct image *image, const struct palette *palette)
     /* loop through each input pixel and insert exact fixed colors */
     for (uint32_t i = 0; i < image->width * image->height; ++i)
     {
-        uint32_t offset = i * 4;
+        uint32_t offset = (((i / image->width) * pitch) + (i % image->width)) * 4;
         uint8_t r = image->data[offset + 0];
         uint8_t g = image->data[offset + 1];
         uint8_t b = image->data[offset + 2];
@@ -600,19 +799,21 @@ int image_quantize(struct image *image, const struct palette *palette)
     liq_image_destroy(liqimage);
     liq_attr_destroy(liqattr);
 
-    free(image->data);
+    memory_arena_free(rows);
+    image_release_pixels(image);
     image->data = new_data;
     image->data_size = new_size;
 
     return 0;
 }
 
-int image_direct_convert(struct image *image, color_format_t fmt)
+int image_direct_convert(struct image *image, color_format_t fmt, const struct image_stages *stages)
 {
     bool bad_alpha;
     uint8_t *new_data;
     uint8_t *dst;
     uint32_t new_size;
+    uint32_t pitch;
 
     switch (fmt)
     {
@@ -631,73 +832,66 @@ int image_direct_convert(struct image *image, color_format_t fmt)
             return -1;
     }
 
+    new_size += stages->width_and_height ? WIDTH_HEIGHT_SIZE : 0;
+
     new_data = memory_alloc(new_size);
     if (new_data == NULL)
     {
         return -1;
     }
 
-    dst = new_data;
-    bad_alpha = false;
+    dst = new_data + image_write_width_and_height(image, stages, new_data);
 
-    /* loop through each input pixel and output new format */
-    for (uint32_t i = 0; i < image->width * image->height; ++i)
-    {
-        uint32_t offset = i * 4;
-        struct color color;
-        uint16_t target;
-        uint8_t alpha;
+    pitch = image->stride ? image->stride : image->width;
 
-        color.r = image->data[offset + 0];
-        color.g = image->data[offset + 1];
-        color.b = image->data[offset + 2];
-        alpha = image->data[offset + 3];
-
-        /* the user might get bad colors if alpha is set */
-        if (alpha != 255)
+    if (fmt != COLOR_888_RGB && fmt != COLOR_888_BGR)
+    {
+        if (pitch == image->width)
         {
-            bad_alpha = true;
+            bad_alpha = cpu_kernels.convert_16(dst, image->data, image->width * image->height, fmt);
         }
-
-        /* convert the color and store to the new data array */
-        switch (fmt)
+        else
         {
-            case COLOR_1555_GRGB:
-                target = color_to_1555_grgb(&color);
-                *dst++ = target & 255;
-                *dst++ = (target >> 8) & 255;
-                break;
-
-            case COLOR_565_RGB:
-                target = color_to_565_rgb(&color);
-                *dst++ = target & 255;
-                *dst++ = (target >> 8) & 255;
-                break;
+            bad_alpha = false;
 
-            case COLOR_565_BGR:
-                target = color_to_565_bgr(&color);
-                *dst++ = target & 255;
-                *dst++ = (target >> 8) & 255;
-                break;
+            for (uint32_t i = 0; i < image->height; ++i)
+            {
+                bad_alpha |= cpu_kernels.convert_16(dst, image->data + (i * pitch * 4), image->width, fmt);
+                dst += image->width * 2;
+            }
+        }
+    }
+    else
+    {
+        bad_alpha = false;
 
-            case COLOR_888_BGR:
-                *dst++ = color.r;
-                *dst++ = color.g;
-                *dst++ = color.b;
-                break;
+        /* loop through each input pixel and output new format */
+        for (uint32_t i = 0; i < image->width * image->height; ++i)
+        {
+            const uint8_t *src = &image->data[(((i / image->width) * pitch) + (i % image->width)) * 4];
 
-            case COLOR_888_RGB:
-                *dst++ = color.b;
-                *dst++ = color.g;
-                *dst++ = color.r;
-                break;
+            /* the user might get bad colors if alpha is set */
+            if (src[3] != 255)
+            {
+                bad_alpha = true;
+            }
 
-            default:
-                break;
+            if (fmt == COLOR_888_BGR)
+            {
+                *dst++ = src[0];
+                *dst++ = src[1];
+                *dst++ = src[2];
+            }
+            else
+            {
+                *dst++ = src[2];
+                *dst++ = src[1];
+                *dst++ = src[0];
+            }
         }
     }
 
-    free(image->data);
+    image_release_pixels(image);
     image->data = new_data;
     image->data_size = new_size;
 
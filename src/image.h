@@ -34,6 +34,7 @@
 #include "bpp.h"
 #include "color.h"
 #include "compress.h"
+#include "file.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -43,6 +44,7 @@ extern "C" {
 #endif
 
 struct palette;
+struct sheet;
 
 struct image
 {
@@ -54,41 +56,77 @@ struct image
     uint32_t width;
     uint32_t height;
 
+    /* encoded input, shared by probing and decoding */
+    struct file_map map;
+
+    /* sprite sheet view, data is borrowed while stride is set */
+    struct sheet *sheet;
+    uint32_t sheet_x;
+    uint32_t sheet_y;
+    uint32_t stride;
+
     /* set by convert */
     uint8_t transparent_index;
     uint32_t quantize_speed;
     uint32_t rotate;
     uint32_t uncompressed_size;
+    uint32_t decompress_delta;
+    uint32_t converted_size;
+    double quantize_time;
+    struct compress_stats compress_stats;
     bool swap_width_height;
     bool gfx;
     bool compressed;
+    compress_mode_t compression;
+
+    /* compression was skipped by compress-min-gain */
+    bool stored;
     bool rlet;
     bool flip_x;
     bool flip_y;
     float dither;
+
+    /* set when streaming outputs */
+    bool converted;
+    uint32_t nr_pending_outputs;
 };
 
 #define WIDTH_HEIGHT_SIZE 2
 
+struct image_stages
+{
+    uint8_t offset;
+    bool rlet;
+    uint8_t transparent_index;
+    const uint8_t *omit_indices;
+    uint32_t nr_omit_indices;
+    bpp_t bpp;
+    uint32_t nr_palette_entries;
+    bool width_and_height;
+    bool swap_width_height;
+};
+
 void image_init(struct image *image, const char *path);
 
 int image_load(struct image *image);
 
-int image_rlet(struct image *image, uint8_t transparent_index);
+int image_orient(struct image *image, uint32_t *data, uint32_t width, uint32_t height);
 
-int image_add_width_and_height(struct image *image, bool swap);
+void image_prefetch(struct image *image);
 
-int image_add_offset(struct image *image, uint8_t offset);
+int image_probe(struct image *image, uint32_t *width, uint32_t *height);
 
-int image_compress(struct image *image, compress_mode_t mode);
+int image_apply_stages(struct image *image, const struct image_stages *stages);
 
-int image_remove_omits(struct image *image, const uint8_t *omit_indices, uint32_t nr_omit_indices);
+int image_compress(struct image *image, compress_mode_t mode, uint32_t min_gain, uint32_t tolerance);
 
-int image_set_bpp(struct image *image, bpp_t bpp, uint32_t palette_nr_entries);
+uint32_t image_in_place_size(const struct image *image);
 
 int image_quantize(struct image *image, const struct palette *palette);
 
-int image_direct_convert(struct image *image, color_format_t fmt);
+int image_direct_convert(struct image *image, color_format_t fmt, const struct image_stages *stages);
+
+void image_release_pixels(struct image *image);
 
 void image_free(struct image *image);
 
@@ -31,13 +31,25 @@
 #include "options.h"
 #include "convert.h"
 #include "clean.h"
+#include "cpu.h"
 #include "icon.h"
 #include "parser.h"
 #include "log.h"
 #include "thread.h"
+#include "report.h"
+#include "compress.h"
 
-static int process_yaml(struct yaml *yaml)
+static int process_yaml(struct yaml *yaml, bool stream)
 {
+    /* reject bad dimensions before decoding anything */
+    for (uint32_t i = 0; i < yaml->nr_converts; ++i)
+    {
+        if (convert_probe(yaml->converts[i]))
+        {
+            return -1;
+        }
+    }
+
     for (uint32_t i = 0; i < yaml->nr_palettes; ++i)
     {
         if (palette_generate(
@@ -54,6 +66,21 @@ static int process_yaml(struct yaml *yaml)
         return -1;
     }
 
+    if (stream)
+    {
+        /* outputs are written as soon as each image is converted */
+        if (output_stream_begin(
+            yaml->outputs,
+            yaml->nr_outputs,
+            yaml->palettes,
+            yaml->nr_palettes,
+            yaml->converts,
+            yaml->nr_converts))
+        {
+            return -1;
+        }
+    }
+
     for (uint32_t i = 0; i < yaml->nr_converts; ++i)
     {
         if (convert_generate(
@@ -70,7 +97,15 @@ static int process_yaml(struct yaml *yaml)
         return -1;
     }
 
-    for (uint32_t i = 0; i < yaml->nr_outputs; ++i)
+    if (stream)
+    {
+        if (output_stream_end())
+        {
+            return -1;
+        }
+    }
+
+    for (uint32_t i = 0; !stream && i < yaml->nr_outputs; ++i)
     {
         if (output_generate(
             yaml->outputs[i],
@@ -112,10 +147,19 @@ int main(int argc, char *argv[])
             break;
     }
 
+    if (cpu_init(options.cpu))
+    {
+        return EXIT_FAILURE;
+    }
+
     if (options.convert_icon)
     {
         ret = icon_convert(&options.icon);
     }
+    else if (options.bench_path != NULL)
+    {
+        ret = compress_bench(options.bench_path);
+    }
     else
     {
         static struct yaml yaml;
@@ -129,8 +173,13 @@ int main(int argc, char *argv[])
 
         if (!ret)
         {
-            thread_pool_init(options.threads);
-            ret = process_yaml(&yaml);
+            thread_pool_init(options.threads, options.memory_limit);
+            compress_set_verify(options.verify);
+            ret = process_yaml(&yaml, options.stream);
+            if (!ret && options.report_path != NULL)
+            {
+                ret = report_write(&yaml, options.report_path);
+            }
             if (!ret)
             {
                 LOG_PRINT("[success] Generated file listing \'%s.lst\'\n", options.yaml_path);
@@ -32,6 +32,25 @@
 #include "log.h"
 
 #include <stdlib.h>
+#include <stdbool.h>
+
+#define MEMORY_ARENA_ALIGN 16
+#define MEMORY_ARENA_CHUNK_SIZE (1024 * 1024)
+
+/* most an idle arena keeps between tasks, larger scratch is freed */
+#define MEMORY_ARENA_KEEP_SIZE MEMORY_ARENA_CHUNK_SIZE
+
+struct memory_chunk
+{
+    struct memory_chunk *next;
+    size_t size;
+    size_t used;
+    size_t last;
+    _Alignas(MEMORY_ARENA_ALIGN) uint8_t data[];
+};
+
+/* arena receiving memory_arena_alloc() requests on this thread */
+static _Thread_local struct memory_arena *memory_arena;
 
 void *memory_alloc(size_t size)
 {
@@ -74,3 +93,127 @@ void *memory_realloc_array(void *ptr, size_t nelem, size_t elsize)
 
     return memory_realloc(ptr, bytes);
 }
+
+static struct memory_chunk *memory_arena_owner(const struct memory_arena *arena, const void *ptr)
+{
+    for (struct memory_chunk *chunk = arena->chunks; chunk != NULL; chunk = chunk->next)
+    {
+        const uint8_t *p = ptr;
+
+        if (p >= chunk->data && p < chunk->data + chunk->size)
+        {
+            return chunk;
+        }
+    }
+
+    return NULL;
+}
+
+void memory_arena_enter(struct memory_arena *arena)
+{
+    memory_arena = arena;
+}
+
+void memory_arena_leave(void)
+{
+    struct memory_arena *arena = memory_arena;
+
+    memory_arena = NULL;
+
+    if (arena == NULL || arena->chunks == NULL)
+    {
+        return;
+    }
+
+    /* a single chunk within the ceiling is simply rewound */
+    if (arena->chunks->next == NULL && arena->chunks->size <= MEMORY_ARENA_KEEP_SIZE)
+    {
+        arena->chunks->used = 0;
+        arena->chunks->last = 0;
+        return;
+    }
+
+    /* otherwise one large task would pin its peak for the rest of the run */
+    memory_arena_destroy(arena);
+}
+
+void memory_arena_destroy(struct memory_arena *arena)
+{
+    struct memory_chunk *chunk = arena->chunks;
+
+    while (chunk != NULL)
+    {
+        struct memory_chunk *next = chunk->next;
+
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->chunks = NULL;
+}
+
+void *memory_arena_alloc(size_t size)
+{
+    struct memory_arena *arena = memory_arena;
+    struct memory_chunk *chunk;
+    size_t aligned;
+
+    if (arena == NULL)
+    {
+        return memory_alloc(size);
+    }
+
+    aligned = (size + MEMORY_ARENA_ALIGN - 1) & ~(size_t)(MEMORY_ARENA_ALIGN - 1);
+    if (aligned < size)
+    {
+        LOG_ERROR("Out of memory.\n");
+        return NULL;
+    }
+
+    chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < aligned)
+    {
+        size_t chunk_size = aligned > MEMORY_ARENA_CHUNK_SIZE ? aligned : MEMORY_ARENA_CHUNK_SIZE;
+
+        chunk = memory_alloc(sizeof(struct memory_chunk) + chunk_size);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->last = 0;
+        arena->chunks = chunk;
+    }
+
+    chunk->last = chunk->used;
+    chunk->used += aligned;
+
+    return chunk->data + chunk->last;
+}
+
+void memory_arena_free(void *ptr)
+{
+    struct memory_arena *arena = memory_arena;
+    struct memory_chunk *chunk;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    chunk = arena != NULL ? memory_arena_owner(arena, ptr) : NULL;
+    if (chunk == NULL)
+    {
+        free(ptr);
+        return;
+    }
+
+    /* only the newest allocation can be given back before the task ends */
+    if ((uint8_t *)ptr == chunk->data + chunk->last && chunk->last < chunk->used)
+    {
+        chunk->used = chunk->last;
+    }
+}
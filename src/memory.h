@@ -44,6 +44,24 @@ void *memory_realloc(void *ptr, size_t size);
 
 void *memory_realloc_array(void *ptr, size_t nelem, size_t elsize);
 
+struct memory_chunk;
+
+/* bump allocator for buffers that only live for one task, keeping at most 1 MiB between tasks */
+struct memory_arena
+{
+    struct memory_chunk *chunks;
+};
+
+void memory_arena_enter(struct memory_arena *arena);
+
+void memory_arena_leave(void);
+
+void memory_arena_destroy(struct memory_arena *arena);
+
+void *memory_arena_alloc(size_t size);
+
+void memory_arena_free(void *ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,6 +57,20 @@ static void options_show(const char *prgm)
     LOG_PRINT("    -t, --threads <count>    Set number of threads when converting. Default 4.\n");
     LOG_PRINT("    -l, --log-level <level>  Set program logging level:\n");
     LOG_PRINT("                             0=none, 1=error, 2=warning, 3=normal\n");
+    LOG_PRINT("    --cpu <level>            Override detected pixel kernels, for testing:\n");
+    LOG_PRINT("                             auto, generic, sse2, ssse3, avx2, neon\n");
+    LOG_PRINT("    --stream                 Write outputs as each image is converted and\n");
+    LOG_PRINT("                             release its pixels, lowering peak memory.\n");
+    LOG_PRINT("    --memory-limit <mb>      Only start conversions while their estimated\n");
+    LOG_PRINT("                             memory fits in this budget. Default none.\n");
+    LOG_PRINT("                             Each thread keeps at most 1 MiB of scratch\n");
+    LOG_PRINT("                             memory between conversions.\n");
+    LOG_PRINT("    --report <file>          Write sizes and timings of every palette,\n");
+    LOG_PRINT("                             image, tile, and AppVar to a JSON file.\n");
+    LOG_PRINT("    --verify                 Decompress all compressed data after it is\n");
+    LOG_PRINT("                             compressed and check it matches the input.\n");
+    LOG_PRINT("    --bench-codecs <file>    Compress <file> with every codec and report\n");
+    LOG_PRINT("                             ratio and throughput, then exit.\n");
     LOG_PRINT("Optional icon options:\n");
     LOG_PRINT("    --icon <file>            Create an icon for use by shell.\n");
     LOG_PRINT("    --icon-description <txt> Specify icon/program description.\n");
@@ -220,6 +234,44 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  :   \'tile-flip-x\': flip tiles across x axis.\n");
     LOG_PRINT("                                  :   \'tile-flip-y\': flip tiles across y axis.\n");
     LOG_PRINT("                                  :   \'pointer-table\': output tile pointers\n");
+    LOG_PRINT("                                  :   \'tilemap\': treat each image as a level.\n");
+    LOG_PRINT("                                  :     Tiles are split out and deduplicated,\n");
+    LOG_PRINT("                                  :     and a \'tile_map\' of the level is output\n");
+    LOG_PRINT("                                  :     with its width and height in tiles.\n");
+    LOG_PRINT("                                  :   \'quantize-once\': quantize the whole\n");
+    LOG_PRINT("                                  :     tileset image in one pass and slice\n");
+    LOG_PRINT("                                  :     tiles from the result. Faster, and\n");
+    LOG_PRINT("                                  :     dithering has no seams between tiles.\n");
+    LOG_PRINT("                                  :   \'deduplicate\': store identical tiles\n");
+    LOG_PRINT("                                  :     once, and output a \'tile_map\' of\n");
+    LOG_PRINT("                                  :     8 or 16-bit unique tile indices.\n");
+    LOG_PRINT("                                  :     Set to \'symmetric\' to also merge\n");
+    LOG_PRINT("                                  :     flipped and rotated copies, adding\n");
+    LOG_PRINT("                                  :     a \'tile_transforms\' table of flags\n");
+    LOG_PRINT("                                  :     applied to the stored tile in this\n");
+    LOG_PRINT("                                  :     order: 1 = flip-x, 2 = flip-y,\n");
+    LOG_PRINT("                                  :     4 = rotate 90 (square tiles only).\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       sheets:                    : A list of sprite sheets. Each sheet is\n");
+    LOG_PRINT("                                  : decoded once, and every sprite in it is\n");
+    LOG_PRINT("                                  : converted as its own image. Sprites are\n");
+    LOG_PRINT("                                  : listed by rectangle, or cut from a grid:\n");
+    LOG_PRINT("                                  :\n");
+    LOG_PRINT("                                  : sheets:\n");
+    LOG_PRINT("                                  :   - image: sheet.png\n");
+    LOG_PRINT("                                  :     sprites:\n");
+    LOG_PRINT("                                  :       - name: hero\n");
+    LOG_PRINT("                                  :         x: 0\n");
+    LOG_PRINT("                                  :         y: 0\n");
+    LOG_PRINT("                                  :         width: 16\n");
+    LOG_PRINT("                                  :         height: 24\n");
+    LOG_PRINT("                                  :   - image: icons.png\n");
+    LOG_PRINT("                                  :     sprite-width: 8\n");
+    LOG_PRINT("                                  :     sprite-height: 8\n");
+    LOG_PRINT("                                  :\n");
+    LOG_PRINT("                                  : Grid sprites are named after the sheet\n");
+    LOG_PRINT("                                  : with a \'_<n>\' suffix, numbered from the\n");
+    LOG_PRINT("                                  : top left, moving right to the bottom-right.\n");
     LOG_PRINT("\n");
     LOG_PRINT("       transparent-index: <index> : Transparent color index in the palette\n");
     LOG_PRINT("                                  : that represents a transparent color.\n");
@@ -262,6 +314,22 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  : conversion and quantization.\n");
     LOG_PRINT("                                  : Available compression modes are below.\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       compress-min-gain: <pct>   : Store images and tiles uncompressed when\n");
+    LOG_PRINT("                                  : compression would shrink them by less\n");
+    LOG_PRINT("                                  : than <pct> percent. A quick match probe\n");
+    LOG_PRINT("                                  : skips the compressor for data that is\n");
+    LOG_PRINT("                                  : clearly incompressible. Stored images are\n");
+    LOG_PRINT("                                  : output like uncompressed ones, with\n");
+    LOG_PRINT("                                  : <name>_compression defined as 0. Tilesets\n");
+    LOG_PRINT("                                  : are stored only if every tile is. Default\n");
+    LOG_PRINT("                                  : is 0, which always keeps compressed data.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       compress-tolerance: <pct>  : Only applicable to \'best\' compression.\n");
+    LOG_PRINT("                                  : Keeps the fastest decompressor whose\n");
+    LOG_PRINT("                                  : result is at most <pct> percent larger\n");
+    LOG_PRINT("                                  : than the smallest one. Default is 0,\n");
+    LOG_PRINT("                                  : which keeps the smallest result.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       width-and-height: <bool>   : Optionally control if the width and\n");
     LOG_PRINT("                                  : height should be placed in the converted\n");
     LOG_PRINT("                                  : image; the first two bytes respectively.\n");
@@ -285,6 +353,8 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  : The palette option \'max-entries\' should be\n");
     LOG_PRINT("                                  : used to limit the palette size for this\n");
     LOG_PRINT("                                  : option to ensure correct quantization.\n");
+    LOG_PRINT("                                  : Cannot be used with \'rlet\' style or\n");
+    LOG_PRINT("                                  : \'omit-indices\'.\n");
     LOG_PRINT("                                  : Default is \'8\'.\n");
     LOG_PRINT("\n");
     LOG_PRINT("       omit-indices: [<list>]     : Omits the specified palette indices\n");
@@ -331,6 +401,27 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  : Adds the \'const\' parameter to output types.\n");
     LOG_PRINT("                                  : Default is \'false\'.\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       decompress-in-place:       : Only applicable to C and assembly outputs.\n");
+    LOG_PRINT("           <bool>                 : Compressed zx0 and zx7 images are placed\n");
+    LOG_PRINT("                                  : at the end of a <name>_data buffer that\n");
+    LOG_PRINT("                                  : is <name>_decompress_delta bytes larger\n");
+    LOG_PRINT("                                  : than the image, so they can decompress\n");
+    LOG_PRINT("                                  : into the same buffer without a second\n");
+    LOG_PRINT("                                  : copy. Default is \'false\'.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       compress: <mode>           : Only applicable to bin outputs.\n");
+    LOG_PRINT("                                  : Packs every palette, image, tileset,\n");
+    LOG_PRINT("                                  : and tile table into one stream that\n");
+    LOG_PRINT("                                  : is compressed with \'zx0\', \'zx7\', or\n");
+    LOG_PRINT("                                  : \'lz4\', so small similar images share\n");
+    LOG_PRINT("                                  : history. The stream is written to\n");
+    LOG_PRINT("                                  : <include>.bin, where <include> is the\n");
+    LOG_PRINT("                                  : include-file without its extension.\n");
+    LOG_PRINT("                                  : <include>_offsets.bin holds the 3-byte\n");
+    LOG_PRINT("                                  : offset of each entry in output order\n");
+    LOG_PRINT("                                  : into the decompressed data, followed\n");
+    LOG_PRINT("                                  : by the decompressed size.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("   AppVars are a special type of output and require a few more options.\n");
     LOG_PRINT("   The below options are only available for AppVars, however the above\n");
     LOG_PRINT("   options can also be used.\n");
@@ -363,9 +454,33 @@ static void options_show(const char *prgm)
     LOG_PRINT("       compress: <mode>           : Compress AppVar data.\n");
     LOG_PRINT("                                  : The AppVar then needs to be decompressed\n");
     LOG_PRINT("                                  : to access image and palette data.\n");
+    LOG_PRINT("                                  : The whole AppVar is compressed as one\n");
+    LOG_PRINT("                                  : stream, so leaving the converts\n");
+    LOG_PRINT("                                  : uncompressed lets images share history.\n");
     LOG_PRINT("                                  : Optional parameter.\n");
     LOG_PRINT("                                  : Available compression modes are below.\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       compress-block-size: <n>   : Splits the data into blocks of <n> bytes\n");
+    LOG_PRINT("                                  : that are compressed independently and in\n");
+    LOG_PRINT("                                  : parallel, at a small cost in ratio.\n");
+    LOG_PRINT("                                  : A table of compressed block sizes is\n");
+    LOG_PRINT("                                  : stored before the blocks, and the\n");
+    LOG_PRINT("                                  : generated <name>_decompress function\n");
+    LOG_PRINT("                                  : unpacks them in order. Requires zx0 or\n");
+    LOG_PRINT("                                  : zx7 compression. Maximum is 32768.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       compress-min-gain: <pct>   : Store the AppVar uncompressed when\n");
+    LOG_PRINT("                                  : compression would shrink it by less\n");
+    LOG_PRINT("                                  : than <pct> percent, and set\n");
+    LOG_PRINT("                                  : <name>_appvar_compression to 0.\n");
+    LOG_PRINT("                                  : Cannot be used with compression blocks.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       compress-tolerance: <pct>  : Only applicable to \'best\' compression.\n");
+    LOG_PRINT("                                  : Keeps the fastest decompressor whose\n");
+    LOG_PRINT("                                  : result is at most <pct> percent larger\n");
+    LOG_PRINT("                                  : than the smallest one. Default is 0,\n");
+    LOG_PRINT("                                  : which keeps the smallest result.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       header-string: <string>    : Prepends <string> to the start of the\n");
     LOG_PRINT("                                  : AppVar's data.\n");
     LOG_PRINT("                                  : Use double quotes to properly interpret\n");
@@ -385,11 +500,23 @@ static void options_show(const char *prgm)
     LOG_PRINT("    and potentially slower decompression as well.\n");
     LOG_PRINT("\n");
     LOG_PRINT("       \"zx0\"                    : Best ratio, slowest (de)compression\n");
+    LOG_PRINT("                                : Each stream is compressed on a single\n");
+    LOG_PRINT("                                : thread, so large AppVars compress\n");
+    LOG_PRINT("                                : faster with \'compress-block-size\'.\n");
     LOG_PRINT("\n");
     LOG_PRINT("       \"zx7\"                    : Moderate ratio, moderate (de)compression\n");
     LOG_PRINT("\n");
     LOG_PRINT("       \"lz4\"                    : Worst ratio, fastest (de)compression\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       \"best\"                   : Tries each mode above and keeps the\n");
+    LOG_PRINT("                                : smallest result, preferring the faster\n");
+    LOG_PRINT("                                : decompressor on ties or when it is within\n");
+    LOG_PRINT("                                : \'compress-tolerance\'. The chosen mode is\n");
+    LOG_PRINT("                                : exported as <name>_compression, where\n");
+    LOG_PRINT("                                : 1 is zx7, 2 is zx0 and 3 is lz4.\n");
+    LOG_PRINT("                                : 0 means the data was stored because of\n");
+    LOG_PRINT("                                : \'compress-min-gain\'.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("--------------------------------------------------------------------------------\n");
     LOG_PRINT("\n");
     LOG_PRINT("Credits:\n");
@@ -495,6 +622,12 @@ static void options_set_default(struct options *options)
     options->clean = false;
     options->yaml_path = yaml_path;
     options->threads = 4;
+    options->cpu = NULL;
+    options->report_path = NULL;
+    options->stream = false;
+    options->memory_limit = 0;
+    options->verify = false;
+    options->bench_path = NULL;
 }
 
 static int options_verify(struct options *options)
@@ -513,7 +646,7 @@ static int options_verify(struct options *options)
         LOG_WARNING("Limiting threads to %u\n", options->threads);
     }
 
-    if (options->convert_icon == true)
+    if (options->convert_icon == true || options->bench_path != NULL)
     {
         return OPTIONS_SUCCESS;
     }
@@ -568,6 +701,12 @@ int options_get(int argc, char *argv[], struct options *options)
             {"log-level",        required_argument, 0, 'l'},
             {"log-color",        required_argument, 0, 'x'},
             {"threads",          required_argument, 0, 't'},
+            {"cpu",              required_argument, 0, 'p'},
+            {"stream",           no_argument,       0, 's'},
+            {"memory-limit",     required_argument, 0, 'm'},
+            {"report",           required_argument, 0, 'r'},
+            {"verify",           no_argument,       0, 'y'},
+            {"bench-codecs",     required_argument, 0, 'b'},
             {0, 0, 0, 0}
         };
         int c = getopt_long(argc, argv, "cnhvi:l:x:t:", long_options, &optidx);
@@ -667,6 +806,46 @@ int options_get(int argc, char *argv[], struct options *options)
                 options->threads = strtoul(optarg, NULL, 0);
                 break;
 
+            case 'p':
+                if (optarg == NULL)
+                {
+                    break;
+                }
+                options->cpu = optarg;
+                break;
+
+            case 's':
+                options->stream = true;
+                break;
+
+            case 'm':
+                if (optarg == NULL)
+                {
+                    break;
+                }
+                options->memory_limit = (size_t)strtoul(optarg, NULL, 0) * 1024 * 1024;
+                break;
+
+            case 'r':
+                if (optarg == NULL)
+                {
+                    break;
+                }
+                options->report_path = optarg;
+                break;
+
+            case 'y':
+                options->verify = true;
+                break;
+
+            case 'b':
+                if (optarg == NULL)
+                {
+                    break;
+                }
+                options->bench_path = optarg;
+                break;
+
             case 'h':
                 options_show(options->prgm);
                 return OPTIONS_IGNORE;
@@ -35,6 +35,7 @@
 #include "icon.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,9 +52,15 @@ struct options
 {
     const char *prgm;
     const char *yaml_path;
+    const char *cpu;
+    const char *report_path;
+    const char *bench_path;
     unsigned int threads;
+    size_t memory_limit;
     bool convert_icon;
     bool clean;
+    bool verify;
+    bool stream;
     struct icon icon;
 };
 
@@ -34,6 +34,7 @@
 #include "memory.h"
 #include "log.h"
 #include "clean.h"
+#include "thread.h"
 
 #include <string.h>
 #include <errno.h>
@@ -85,9 +86,6 @@ int appvar_insert_entry(struct appvar *appvar, uint32_t index, uint32_t data)
 int output_appvar_init(struct output *output)
 {
     struct appvar *appvar = &output->appvar;
-    uint32_t nr_entries;
-    uint32_t offset;
-    uint32_t index;
 
     if (appvar->header_size > 0)
     {
@@ -100,12 +98,36 @@ int output_appvar_init(struct output *output)
         appvar->size += appvar->header_size;
     }
 
-    if (appvar->lut == false)
+    /* the lut is inserted once every item size is known */
+    appvar->data_offset = appvar->header_size;
+
+    if (appvar->block_size != 0 &&
+        (compress_codec(appvar->compress) == NULL ||
+         compress_codec(appvar->compress)->decompress_function == NULL))
+    {
+        LOG_ERROR("AppVar '%s' compression blocks require zx0 or zx7 compression.\n",
+            appvar->name);
+        return -1;
+    }
+
+    /* the generated block decompressor expects every block compressed */
+    if (appvar->block_size != 0 && appvar->compress_min_gain != 0)
     {
-        appvar->data_offset = appvar->header_size;
-        return 0;
+        LOG_ERROR("AppVar '%s' compression blocks cannot use a minimum gain.\n",
+            appvar->name);
+        return -1;
     }
 
+    return 0;
+}
+
+static int output_appvar_lut(struct output *output)
+{
+    struct appvar *appvar = &output->appvar;
+    uint32_t nr_entries;
+    uint32_t offset;
+    uint32_t index;
+
     nr_entries = 0;
 
     for (uint32_t i = 0; i < output->nr_palettes; ++i)
@@ -128,6 +150,16 @@ int output_appvar_init(struct output *output)
 
             nr_entries++;
 
+            if (tileset->tile_map != NULL)
+            {
+                nr_entries++;
+            }
+
+            if (tileset->tile_transforms != NULL)
+            {
+                nr_entries++;
+            }
+
             for (uint32_t l = 0; l < tileset->nr_tiles; l++)
             {
                 nr_entries++;
@@ -148,6 +180,10 @@ int output_appvar_init(struct output *output)
         return -1;
     }
 
+    /* make room for the lut between the header and the items */
+    memmove(&appvar->data[appvar->header_size + appvar->data_offset],
+            &appvar->data[appvar->header_size],
+            appvar->size - appvar->header_size);
     appvar->size += appvar->data_offset;
 
     /* first entry is number of entries */
@@ -195,6 +231,24 @@ int output_appvar_init(struct output *output)
                 offset += tileset_offset;
 
                 index++;
+
+                if (tileset->tile_map != NULL)
+                {
+                    appvar_insert_entry(appvar, index, offset);
+
+                    offset += tileset->tile_map_size;
+
+                    index++;
+                }
+
+                if (tileset->tile_transforms != NULL)
+                {
+                    appvar_insert_entry(appvar, index, offset);
+
+                    offset += tileset->nr_tile_map_entries;
+
+                    index++;
+                }
             }
         }
 
@@ -248,6 +302,24 @@ int output_appvar_init(struct output *output)
                 offset += tileset_offset;
 
                 index++;
+
+                if (tileset->tile_map != NULL)
+                {
+                    appvar_insert_entry(appvar, index, offset);
+
+                    offset += tileset->tile_map_size;
+
+                    index++;
+                }
+
+                if (tileset->tile_transforms != NULL)
+                {
+                    appvar_insert_entry(appvar, index, offset);
+
+                    offset += tileset->nr_tile_map_entries;
+
+                    index++;
+                }
             }
         }
 
@@ -318,6 +390,28 @@ int output_appvar_tileset(struct output *output, const struct tileset *tileset)
         appvar->size += tile->data_size;
     }
 
+    if (tileset->tile_map != NULL)
+    {
+        if (validate_data_size(appvar, tileset->tile_map_size) != 0)
+        {
+            return -1;
+        }
+
+        memcpy(&appvar->data[appvar->size], tileset->tile_map, tileset->tile_map_size);
+        appvar->size += tileset->tile_map_size;
+    }
+
+    if (tileset->tile_transforms != NULL)
+    {
+        if (validate_data_size(appvar, tileset->nr_tile_map_entries) != 0)
+        {
+            return -1;
+        }
+
+        memcpy(&appvar->data[appvar->size], tileset->tile_transforms, tileset->nr_tile_map_entries);
+        appvar->size += tileset->nr_tile_map_entries;
+    }
+
     return 0;
 }
 
@@ -377,6 +471,35 @@ static void output_appvar_c_include_file_palettes(struct output *output, FILE *f
     }
 }
 
+static void output_appvar_c_tileset_compression(const struct tileset *tileset, FILE *fdh)
+{
+    compress_mode_t mode = tileset_compression(tileset);
+    uint32_t delta;
+
+    if (tileset_decompress_delta(tileset, &delta))
+    {
+        fprintf(fdh, "#define %s_decompress_delta %u\n",
+            tileset->image.name,
+            delta);
+    }
+
+    if (mode != COMPRESS_BEST)
+    {
+        fprintf(fdh, "#define %s_compression %u\n",
+            tileset->image.name,
+            mode);
+        return;
+    }
+
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        fprintf(fdh, "#define %s_tile_%u_compression %u\n",
+            tileset->image.name,
+            i,
+            tileset->tiles[i].compression);
+    }
+}
+
 static void output_appvar_c_include_file_converts(struct output *output, FILE *fdh, uint32_t *index)
 {
     for (uint32_t i = 0; i < output->nr_converts; ++i)
@@ -409,6 +532,17 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
                     image->name,
                     output->appvar.name,
                     *index);
+
+                fprintf(fdh, "#define %s_compression %u\n",
+                    image->name,
+                    image->compression);
+
+                if (compress_mode_in_place(image->compression))
+                {
+                    fprintf(fdh, "#define %s_decompress_delta %u\n",
+                        image->name,
+                        image->decompress_delta);
+                }
             }
             else
             {
@@ -418,6 +552,13 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
                     image->name,
                     *index);
 
+                if (image->stored)
+                {
+                    fprintf(fdh, "#define %s_compression %u\n",
+                        image->name,
+                        image->compression);
+                }
+
                 if (image->gfx)
                 {
                     fprintf(fdh, "#define %s ((%s*)%s_appvar[%u])\n",
@@ -457,6 +598,8 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
                     tileset->image.name,
                     tileset->nr_tiles);
 
+                output_appvar_c_tileset_compression(tileset, fdh);
+
                 for (uint32_t l = 0; l < tileset->nr_tiles; l++)
                 {
                     fprintf(fdh, "#define %s_tile_%u_compressed %s_tiles_compressed[%u]\n",
@@ -478,6 +621,11 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
                 fprintf(fdh, "extern unsigned char *%s_tiles_data[%u];\n",
                     tileset->image.name,
                     tileset->nr_tiles);
+
+                if (tileset->stored)
+                {
+                    output_appvar_c_tileset_compression(tileset, fdh);
+                }
                     
                 if (tileset->image.gfx)
                 {
@@ -510,6 +658,38 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
             }
 
             *index = *index + 1;
+
+            if (tileset->tile_map != NULL)
+            {
+                fprintf(fdh, "#define %s_num_tile_map_entries %u\n",
+                    tileset->image.name,
+                    tileset->nr_tile_map_entries);
+                fprintf(fdh, "#define %s_tile_map_entry_size %u\n",
+                    tileset->image.name,
+                    tileset->tile_map_entry_size);
+                fprintf(fdh, "#define %s_tile_map_width %u\n",
+                    tileset->image.name,
+                    tileset->tile_map_width);
+                fprintf(fdh, "#define %s_tile_map_height %u\n",
+                    tileset->image.name,
+                    tileset->tile_map_height);
+                fprintf(fdh, "#define %s_tile_map %s_appvar[%u]\n",
+                    tileset->image.name,
+                    output->appvar.name,
+                    *index);
+
+                *index = *index + 1;
+            }
+
+            if (tileset->tile_transforms != NULL)
+            {
+                fprintf(fdh, "#define %s_tile_transforms %s_appvar[%u]\n",
+                    tileset->image.name,
+                    output->appvar.name,
+                    *index);
+
+                *index = *index + 1;
+            }
         }
     }
 }
@@ -531,11 +711,37 @@ void output_appvar_c_include_file(struct output *output, FILE *fdh)
         appvar->name,
         (unsigned int)appvar->size);
 
-    if (appvar->compress != COMPRESS_NONE)
+    if (appvar->compression != COMPRESS_NONE)
     {
         fprintf(fdh, "#define %s_appvar_uncompressed_size %u\n",
             appvar->name,
             (unsigned int)appvar->uncompressed_size);
+        fprintf(fdh, "#define %s_appvar_compression %u\n",
+            appvar->name,
+            appvar->compression);
+
+        if (appvar->nr_blocks == 0 && compress_mode_in_place(appvar->compression))
+        {
+            fprintf(fdh, "#define %s_appvar_decompress_delta %u\n",
+                appvar->name,
+                appvar->decompress_delta);
+        }
+
+        if (appvar->nr_blocks != 0)
+        {
+            fprintf(fdh, "#define %s_appvar_block_size %u\n",
+                appvar->name,
+                appvar->block_size);
+            fprintf(fdh, "#define %s_appvar_blocks_num %u\n",
+                appvar->name,
+                appvar->nr_blocks);
+        }
+    }
+    else if (appvar->compress != COMPRESS_NONE)
+    {
+        /* stored by compress-min-gain, so it reads like an uncompressed appvar */
+        fprintf(fdh, "#define %s_appvar_compression 0\n",
+            appvar->name);
     }
 
     if (output->order == OUTPUT_PALETTES_FIRST)
@@ -559,9 +765,15 @@ void output_appvar_c_include_file(struct output *output, FILE *fdh)
         appvar->name,
         appvar->nr_entries);
 
+    if (appvar->nr_blocks != 0)
+    {
+        fprintf(fdh, "unsigned char %s_decompress(void *addr);\n",
+            appvar->name);
+    }
+
     if (appvar->init)
     {
-        if (appvar->compress != COMPRESS_NONE)
+        if (appvar->compression != COMPRESS_NONE)
         {
             fprintf(fdh, "unsigned char %s_init(void *addr);\n",
                 appvar->name);
@@ -581,6 +793,49 @@ void output_appvar_c_include_file(struct output *output, FILE *fdh)
     fprintf(fdh, "#endif\n");
 }
 
+/* the block table holds the compressed size of each block */
+static void output_appvar_c_decompress(const struct appvar *appvar, FILE *fds)
+{
+    fprintf(fds, "unsigned char %s_decompress(void *addr)\n", appvar->name);
+    fprintf(fds, "{\n");
+    fprintf(fds, "    const unsigned short *table;\n");
+    fprintf(fds, "    const unsigned char *src;\n");
+    fprintf(fds, "    unsigned char *dst;\n");
+    fprintf(fds, "    unsigned int i;\n");
+    fprintf(fds, "    uint8_t appvar;\n\n");
+    fprintf(fds, "    appvar = ti_Open(\"%s\", \"r\");\n", appvar->name);
+    fprintf(fds, "    if (appvar == 0)\n");
+    fprintf(fds, "    {\n");
+    fprintf(fds, "        return 0;\n");
+    fprintf(fds, "    }\n\n");
+    fprintf(fds, "    table = ti_GetDataPtr(appvar);\n");
+    fprintf(fds, "    src = (const unsigned char*)(table + %u);\n", appvar->nr_blocks);
+    fprintf(fds, "    dst = addr;\n");
+    fprintf(fds, "    for (i = 0; i < %u; i++)\n", appvar->nr_blocks);
+    fprintf(fds, "    {\n");
+    fprintf(fds, "        %s(dst, src);\n",
+        compress_codec(appvar->compress)->decompress_function);
+    fprintf(fds, "        src += table[i];\n");
+    fprintf(fds, "        dst += %u;\n", appvar->block_size);
+    fprintf(fds, "    }\n\n");
+    fprintf(fds, "    ti_Close(appvar);\n\n");
+    fprintf(fds, "    return 1;\n");
+    fprintf(fds, "}\n\n");
+}
+
+static void output_appvar_c_decompress_call(const struct appvar *appvar, FILE *fds)
+{
+    if (appvar->nr_blocks == 0)
+    {
+        return;
+    }
+
+    fprintf(fds, "    if (!%s_decompress(addr))\n", appvar->name);
+    fprintf(fds, "    {\n");
+    fprintf(fds, "        return 0;\n");
+    fprintf(fds, "    }\n\n");
+}
+
 void output_appvar_c_source_file(struct output *output, FILE *fds)
 {
     struct appvar *appvar = &output->appvar;
@@ -588,15 +843,24 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
 
     fprintf(fds, "#include \"%s\"\n", output->include_file);
     fprintf(fds, "#include <stdint.h>\n");
-    if (appvar->compress == COMPRESS_NONE)
+    if (appvar->compression == COMPRESS_NONE || appvar->nr_blocks != 0)
     {
         fprintf(fds, "#include <fileioc.h>\n");
     }
+    if (appvar->nr_blocks != 0)
+    {
+        fprintf(fds, "#include <compression.h>\n");
+    }
     fprintf(fds, "\n");
     fprintf(fds, "#define %s_HEADER_SIZE %u\n",
         appvar->name, appvar->header_size);
     fprintf(fds, "\n");
 
+    if (appvar->nr_blocks != 0)
+    {
+        output_appvar_c_decompress(appvar, fds);
+    }
+
     if (appvar->lut == false)
     {
         fprintf(fds, "unsigned char *%s_appvar[%u] =\n{\n",
@@ -640,6 +904,22 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
                     offset);
 
                 offset += tileset_offset;
+
+                if (tileset->tile_map != NULL)
+                {
+                    fprintf(fds, "    (unsigned char*)%u,\n",
+                        offset);
+
+                    offset += tileset->tile_map_size;
+                }
+
+                if (tileset->tile_transforms != NULL)
+                {
+                    fprintf(fds, "    (unsigned char*)%u,\n",
+                        offset);
+
+                    offset += tileset->nr_tile_map_entries;
+                }
             }
         }
 
@@ -720,12 +1000,13 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
 
         if (appvar->lut == false)
         {
-            if (appvar->compress != COMPRESS_NONE)
+            if (appvar->compression != COMPRESS_NONE)
             {
                 fprintf(fds, "unsigned char %s_init(void *addr)\n", appvar->name);
                 fprintf(fds, "{\n");
                 fprintf(fds, "    uintptr_t data;\n");
                 fprintf(fds, "    unsigned int i;\n\n");
+                output_appvar_c_decompress_call(appvar, fds);
                 fprintf(fds, "    data = (uintptr_t)addr - (uintptr_t)%s_appvar[0] + %s_HEADER_SIZE;\n", appvar->name, appvar->name);
                 fprintf(fds, "    for (i = 0; i < %u; i++)\n", appvar->nr_entries);
                 fprintf(fds, "    {\n");
@@ -794,7 +1075,7 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
         }
         else
         {
-            if (appvar->compress != COMPRESS_NONE)
+            if (appvar->compression != COMPRESS_NONE)
             {
                 fprintf(fds, "\nunsigned char %s_init(void *addr)\n", appvar->name);
                 fprintf(fds, "{\n");
@@ -819,6 +1100,7 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
                 {
                     fprintf(fds, "    unsigned int i;\n\n");
                 }
+                output_appvar_c_decompress_call(appvar, fds);
                 fprintf(fds, "    table = base = (unsigned char*)addr + %s_HEADER_SIZE;\n", appvar->name);
                 fprintf(fds, "    if (*table != %u)\n", appvar->total_entries - 1);
                 fprintf(fds, "    {\n");
@@ -922,11 +1204,36 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
         appvar->name,
         (unsigned int)appvar->size);
 
-    if (appvar->compress != COMPRESS_NONE)
+    if (appvar->compression != COMPRESS_NONE)
     {
         fprintf(fdh, "%s_appvar_uncompressed_size := %u\n",
             appvar->name,
             (unsigned int)appvar->uncompressed_size);
+        fprintf(fdh, "%s_appvar_compression := %u\n",
+            appvar->name,
+            appvar->compression);
+
+        if (appvar->nr_blocks == 0 && compress_mode_in_place(appvar->compression))
+        {
+            fprintf(fdh, "%s_appvar_decompress_delta := %u\n",
+                appvar->name,
+                appvar->decompress_delta);
+        }
+
+        if (appvar->nr_blocks != 0)
+        {
+            fprintf(fdh, "%s_appvar_block_size := %u\n",
+                appvar->name,
+                appvar->block_size);
+            fprintf(fdh, "%s_appvar_blocks_num := %u\n",
+                appvar->name,
+                appvar->nr_blocks);
+        }
+    }
+    else if (appvar->compress != COMPRESS_NONE)
+    {
+        fprintf(fdh, "%s_appvar_compression := 0\n",
+            appvar->name);
     }
 
     for (uint32_t o = 0; o < 2; ++o)
@@ -986,6 +1293,20 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
                             convert->name,
                             image->name,
                             offset);
+                        fprintf(fdh, "%s_%s_%s_compression := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->compression);
+
+                        if (compress_mode_in_place(image->compression))
+                        {
+                            fprintf(fdh, "%s_%s_%s_decompress_delta := %u\n",
+                                output->appvar.name,
+                                convert->name,
+                                image->name,
+                                image->decompress_delta);
+                        }
                     }
                     else
                     {
@@ -994,6 +1315,15 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
                             convert->name,
                             image->name,
                             offset);
+
+                        if (image->stored)
+                        {
+                            fprintf(fdh, "%s_%s_%s_compression := %u\n",
+                                output->appvar.name,
+                                convert->name,
+                                image->name,
+                                image->compression);
+                        }
                     }
 
                     nr_entries++;
@@ -1043,9 +1373,91 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
                             offset + tileset_offset);
                     }
 
+                    if (tileset->compressed || tileset->stored)
+                    {
+                        compress_mode_t mode = tileset_compression(tileset);
+                        uint32_t delta;
+
+                        if (tileset_decompress_delta(tileset, &delta))
+                        {
+                            fprintf(fdh, "%s_%s_%s_decompress_delta := %u\n",
+                                output->appvar.name,
+                                convert->name,
+                                tileset->image.name,
+                                delta);
+                        }
+
+                        if (mode != COMPRESS_BEST)
+                        {
+                            fprintf(fdh, "%s_%s_%s_compression := %u\n",
+                                output->appvar.name,
+                                convert->name,
+                                tileset->image.name,
+                                mode);
+                        }
+                        else
+                        {
+                            for (uint32_t l = 0; l < tileset->nr_tiles; l++)
+                            {
+                                fprintf(fdh, "%s_%s_%s_tile_%u_compression := %u\n",
+                                    output->appvar.name,
+                                    convert->name,
+                                    tileset->image.name,
+                                    l,
+                                    tileset->tiles[l].compression);
+                            }
+                        }
+                    }
+
                     nr_entries++;
 
                     offset += tileset_offset;
+
+                    if (tileset->tile_map != NULL)
+                    {
+                        fprintf(fdh, "%s_%s_%s_num_tile_map_entries := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            tileset->image.name,
+                            tileset->nr_tile_map_entries);
+                        fprintf(fdh, "%s_%s_%s_tile_map_entry_size := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            tileset->image.name,
+                            tileset->tile_map_entry_size);
+                        fprintf(fdh, "%s_%s_%s_tile_map_width := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            tileset->image.name,
+                            tileset->tile_map_width);
+                        fprintf(fdh, "%s_%s_%s_tile_map_height := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            tileset->image.name,
+                            tileset->tile_map_height);
+                        fprintf(fdh, "%s_%s_%s_tile_map_offset := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            tileset->image.name,
+                            offset);
+
+                        nr_entries++;
+
+                        offset += tileset->tile_map_size;
+                    }
+
+                    if (tileset->tile_transforms != NULL)
+                    {
+                        fprintf(fdh, "%s_%s_%s_tile_transforms_offset := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            tileset->image.name,
+                            offset);
+
+                        nr_entries++;
+
+                        offset += tileset->nr_tile_map_entries;
+                    }
                 }
             }
         }
@@ -1067,6 +1479,65 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
         appvar->header_size);
 }
 
+/* stores the compressed block sizes, then each block back to back */
+static int output_appvar_join_blocks(struct output *output)
+{
+    struct appvar *appvar = &output->appvar;
+    uint32_t size = appvar->nr_blocks * sizeof(uint16_t);
+    uint8_t *data;
+
+    for (uint32_t i = 0; i < appvar->nr_blocks; ++i)
+    {
+        if (output->blocks[i].data == NULL)
+        {
+            return -1;
+        }
+
+        size += output->blocks[i].size;
+    }
+
+    if (size > APPVAR_MAX_DATA_SIZE)
+    {
+        LOG_ERROR("Too much data for AppVar '%s'.\n", appvar->name);
+        return -1;
+    }
+
+    data = memory_alloc(size);
+    if (data == NULL)
+    {
+        return -1;
+    }
+
+    size = 0;
+
+    for (uint32_t i = 0; i < appvar->nr_blocks; ++i)
+    {
+        data[size++] = output->blocks[i].size & 255;
+        data[size++] = (output->blocks[i].size >> 8) & 255;
+    }
+
+    for (uint32_t i = 0; i < appvar->nr_blocks; ++i)
+    {
+        struct output_block *block = &output->blocks[i];
+
+        memcpy(&data[size], block->data, block->size);
+        size += block->size;
+
+        appvar->compress_stats.sizes[appvar->compress] += block->size;
+        appvar->compress_stats.time += block->compress_stats.time;
+
+        free(block->data);
+        block->data = NULL;
+    }
+
+    free(appvar->data);
+    appvar->data = data;
+    appvar->size = size;
+    appvar->compression = appvar->compress;
+
+    return 0;
+}
+
 int output_appvar_include(struct output *output)
 {
     struct appvar *appvar = &output->appvar;
@@ -1087,16 +1558,31 @@ int output_appvar_include(struct output *output)
         goto error;
     }
 
-    appvar->uncompressed_size = appvar->size;
+    if (output->blocks != NULL)
+    {
+        if (output_appvar_join_blocks(output))
+        {
+            goto error;
+        }
+    }
+    else if (appvar->lut && output_appvar_lut(output))
+    {
+        goto error;
+    }
+    else
+    {
+        appvar->uncompressed_size = appvar->size;
+    }
 
-    if (appvar->compress != COMPRESS_NONE)
+    if (output->blocks == NULL && appvar->compress != COMPRESS_NONE)
     {
         size_t size = appvar->size;
         void *original_data = appvar->data;
 
         LOG_INFO(" - Compressing AppVar \'%s\'\n", appvar->name);
 
-        appvar->data = compress_array(original_data, &size, appvar->compress);
+        appvar->compression = appvar->compress;
+        appvar->data = compress_array(original_data, &size, &appvar->compression, appvar->compress_min_gain, appvar->compress_tolerance, &appvar->compress_stats);
         free(original_data);
 
         if (appvar->data == NULL)
@@ -1106,6 +1592,7 @@ int output_appvar_include(struct output *output)
         }
 
         appvar->size = size;
+        appvar->decompress_delta = appvar->compress_stats.delta;
     }
 
     if (appvar->size > APPVAR_MAX_DATA_SIZE)
@@ -1183,3 +1670,85 @@ error:
     free(var_c_name);
     return -1;
 }
+
+static bool output_appvar_compress_block(void *arg)
+{
+    struct output_block *block = arg;
+    struct output *output = block->output;
+    struct appvar *appvar = &output->appvar;
+    uint32_t offset = (block - output->blocks) * appvar->block_size;
+    compress_mode_t mode = appvar->compress;
+    size_t size = appvar->uncompressed_size - offset;
+    bool ret = true;
+
+    if (size > appvar->block_size)
+    {
+        size = appvar->block_size;
+    }
+
+    block->data = compress_array(&appvar->data[offset], &size, &mode, 0, 0, &block->compress_stats);
+    if (block->data == NULL)
+    {
+        LOG_ERROR("Failed to compress AppVar.\n");
+        ret = false;
+    }
+    else
+    {
+        block->size = size;
+    }
+
+    /* the last block writes the appvar */
+    if (atomic_fetch_sub(&output->nr_pending_blocks, 1) == 1)
+    {
+        if (ret && output_appvar_include(output))
+        {
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+int output_appvar_compress_blocks(struct output *output)
+{
+    struct appvar *appvar = &output->appvar;
+    uint32_t nr_blocks;
+
+    if (appvar->lut && output_appvar_lut(output))
+    {
+        return -1;
+    }
+
+    appvar->uncompressed_size = appvar->size;
+
+    nr_blocks = (appvar->size + appvar->block_size - 1) / appvar->block_size;
+
+    output->blocks = memory_realloc_array(NULL, nr_blocks, sizeof(struct output_block));
+    if (output->blocks == NULL)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < nr_blocks; ++i)
+    {
+        output->blocks[i].output = output;
+        output->blocks[i].data = NULL;
+        output->blocks[i].size = 0;
+        memset(&output->blocks[i].compress_stats, 0, sizeof output->blocks[i].compress_stats);
+    }
+
+    appvar->nr_blocks = nr_blocks;
+    output->nr_pending_blocks = nr_blocks;
+
+    LOG_INFO(" - Compressing AppVar '%s' (%u blocks)\n", appvar->name, nr_blocks);
+
+    for (uint32_t i = 0; i < nr_blocks; ++i)
+    {
+        if (!thread_start(output_appvar_compress_block, &output->blocks[i]))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
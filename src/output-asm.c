@@ -92,6 +92,22 @@ int output_asm_image(struct output *output, const struct image *image)
     if (image->compressed)
     {
         fprintf(fds, "%s_compressed_size := %u\n", image->name, image->data_size);
+        fprintf(fds, "%s_compression := %u\n", image->name, image->compression);
+
+        if (compress_mode_in_place(image->compression))
+        {
+            fprintf(fds, "%s_decompress_delta := %u\n", image->name, image->decompress_delta);
+
+            /* reserve the head of the buffer the data decompresses over */
+            if (output->in_place)
+            {
+                fprintf(fds, "%s_data:\n\trb\t%u\n", image->name, image_in_place_size(image) - image->data_size);
+            }
+        }
+    }
+    else if (image->stored)
+    {
+        fprintf(fds, "%s_compression := %u\n", image->name, image->compression);
     }
     fprintf(fds, "%s:\n\tdb\t", image->name);
 
@@ -132,6 +148,52 @@ int output_asm_tileset(struct output *output, const struct tileset *tileset)
         tileset->image.name,
         tileset->nr_tiles);
 
+    if (tileset->compressed || tileset->stored)
+    {
+        compress_mode_t mode = tileset_compression(tileset);
+        uint32_t delta;
+
+        if (tileset_decompress_delta(tileset, &delta))
+        {
+            fprintf(fds, "%s_decompress_delta := %u\n",
+                tileset->image.name,
+                delta);
+        }
+
+        if (mode != COMPRESS_BEST)
+        {
+            fprintf(fds, "%s_compression := %u\n",
+                tileset->image.name,
+                mode);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+            {
+                fprintf(fds, "%s_tile_%u_compression := %u\n",
+                    tileset->image.name,
+                    i,
+                    tileset->tiles[i].compression);
+            }
+        }
+    }
+
+    if (tileset->tile_map != NULL)
+    {
+        fprintf(fds, "%s_num_tile_map_entries := %u\n",
+            tileset->image.name,
+            tileset->nr_tile_map_entries);
+        fprintf(fds, "%s_tile_map_entry_size := %u\n",
+            tileset->image.name,
+            tileset->tile_map_entry_size);
+        fprintf(fds, "%s_tile_map_width := %u\n",
+            tileset->image.name,
+            tileset->tile_map_width);
+        fprintf(fds, "%s_tile_map_height := %u\n",
+            tileset->image.name,
+            tileset->tile_map_height);
+    }
+
     for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
     {
         struct tileset_tile *tile = &tileset->tiles[i];
@@ -141,6 +203,20 @@ int output_asm_tileset(struct output *output, const struct tileset *tileset)
         output_asm_array(tile->data, tile->data_size, fds);
     }
 
+    if (tileset->tile_map != NULL)
+    {
+        fprintf(fds, "%s_tile_map:\n\tdb\t", tileset->image.name);
+
+        output_asm_array(tileset->tile_map, tileset->tile_map_size, fds);
+    }
+
+    if (tileset->tile_transforms != NULL)
+    {
+        fprintf(fds, "%s_tile_transforms:\n\tdb\t", tileset->image.name);
+
+        output_asm_array(tileset->tile_transforms, tileset->nr_tile_map_entries, fds);
+    }
+
     if (tileset->p_table == true)
     {
         fprintf(fds, "%s_tiles:\n", tileset->image.name);
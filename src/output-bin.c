@@ -39,66 +39,154 @@
 #include <errno.h>
 #include <string.h>
 
-static int output_bin_array(unsigned char *data, uint32_t size, FILE *fdo)
+/* compressed outputs pack every entry into one solid stream */
+static bool output_bin_solid(const struct output *output)
 {
-    int ret = fwrite(data, size, 1, fdo);
+    return output->compress != COMPRESS_NONE;
+}
 
-    return ret == 1 ? 0 : 1;
+static int output_bin_solid_entry(struct output *output)
+{
+    uint32_t *offsets;
+
+    offsets = memory_realloc_array(output->solid_offsets, output->nr_solid_entries + 1, sizeof(uint32_t));
+    if (offsets == NULL)
+    {
+        return -1;
+    }
+
+    output->solid_offsets = offsets;
+    output->solid_offsets[output->nr_solid_entries++] = output->solid_size;
+
+    return 0;
 }
 
-int output_bin_image(struct output *output, const struct image *image)
+static int output_bin_solid_append(struct output *output, const void *data, uint32_t size)
+{
+    uint8_t *solid_data;
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    solid_data = memory_realloc_array(output->solid_data, output->solid_size + size, 1);
+    if (solid_data == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(&solid_data[output->solid_size], data, size);
+
+    output->solid_data = solid_data;
+    output->solid_size += size;
+
+    return 0;
+}
+
+/* solid outputs start a new entry instead of opening a file */
+static int output_bin_open(struct output *output, const char *name, const char *suffix, FILE **fd)
 {
     char *source;
-    FILE *fds;
-    int ret;
 
-    source = strings_concat(output->directory, image->name, ".bin", 0);
+    *fd = NULL;
+
+    if (output_bin_solid(output))
+    {
+        return output_bin_solid_entry(output);
+    }
+
+    source = strings_concat(output->directory, name, suffix, 0);
     if (source == NULL)
     {
-        goto error;
+        return -1;
     }
 
     LOG_INFO(" - Writing \'%s\'\n", source);
 
-    fds = clean_fopen(source, "wb");
-    if (fds == NULL)
+    *fd = clean_fopen(source, "wb");
+    if (*fd == NULL)
     {
         LOG_ERROR("Could not open file: %s\n", strerror(errno));
-        goto error;
+        free(source);
+        return -1;
     }
 
-    ret = output_bin_array(image->data, image->data_size, fds);
+    free(source);
 
-    fclose(fds);
+    return 0;
+}
 
-    free(source);
+static void output_bin_close(FILE *fd)
+{
+    if (fd != NULL)
+    {
+        fclose(fd);
+    }
+}
 
-    return ret;
+static int output_bin_array(struct output *output, const void *data, uint32_t size, FILE *fdo)
+{
+    int ret;
 
-error:
-    free(source);
-    return -1;
+    if (fdo == NULL)
+    {
+        return output_bin_solid_append(output, data, size);
+    }
+
+    ret = fwrite(data, size, 1, fdo);
+
+    return ret == 1 ? 0 : 1;
 }
 
-int output_bin_tileset(struct output *output, const struct tileset *tileset)
+int output_bin_image(struct output *output, const struct image *image)
 {
-    char *source;
     FILE *fds;
-    uint32_t i;
+    int ret;
 
-    source = strings_concat(output->directory, tileset->image.name, ".bin", 0);
-    if (source == NULL)
+    if (output_bin_open(output, image->name, ".bin", &fds))
     {
-        goto error;
+        return -1;
     }
 
-    LOG_INFO(" - Writing \'%s\'\n", source);
+    ret = output_bin_array(output, image->data, image->data_size, fds);
+
+    output_bin_close(fds);
+
+    return ret;
+}
 
-    fds = clean_fopen(source, "wb");
-    if (fds == NULL)
+/* writes a per-tile table next to the tileset */
+static int output_bin_table(struct output *output,
+                            const struct tileset *tileset,
+                            const char *suffix,
+                            unsigned char *data,
+                            uint32_t size)
+{
+    FILE *fds;
+    int ret;
+
+    if (output_bin_open(output, tileset->image.name, suffix, &fds))
     {
-        LOG_ERROR("Could not open file: %s\n", strerror(errno));
-        goto error;
+        return -1;
+    }
+
+    ret = output_bin_array(output, data, size, fds);
+
+    output_bin_close(fds);
+
+    return ret;
+}
+
+int output_bin_tileset(struct output *output, const struct tileset *tileset)
+{
+    FILE *fds;
+    uint32_t i;
+    int ret = 0;
+
+    if (output_bin_open(output, tileset->image.name, ".bin", &fds))
+    {
+        return -1;
     }
 
     if (tileset->p_table == true)
@@ -113,7 +201,7 @@ int output_bin_tileset(struct output *output, const struct tileset *tileset)
             tile_offset[1] = (offset >> 8) & 255;
             tile_offset[2] = (offset >> 16) & 255;
 
-            output_bin_array(tile_offset, sizeof tile_offset, fds);
+            ret |= output_bin_array(output, tile_offset, sizeof tile_offset, fds);
 
             offset += tileset->tiles[i].data_size;
         }
@@ -123,27 +211,89 @@ int output_bin_tileset(struct output *output, const struct tileset *tileset)
     {
         struct tileset_tile *tile = &tileset->tiles[i];
 
-        output_bin_array(tile->data, tile->data_size, fds);
+        ret |= output_bin_array(output, tile->data, tile->data_size, fds);
     }
 
-    fclose(fds);
+    output_bin_close(fds);
 
-    free(source);
+    if (ret)
+    {
+        return -1;
+    }
 
-    return 0;
+    if (tileset->tile_map != NULL)
+    {
+        if (output_bin_table(output, tileset, "_tile_map.bin",
+                tileset->tile_map, tileset->tile_map_size))
+        {
+            return -1;
+        }
+    }
 
-error:
-    free(source);
-    return -1;
+    if (tileset->tile_transforms != NULL)
+    {
+        if (output_bin_table(output, tileset, "_tile_transforms.bin",
+                tileset->tile_transforms, tileset->nr_tile_map_entries))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 int output_bin_palette(struct output *output, const struct palette *palette)
 {
-    char *source;
     FILE *fds;
     uint32_t i;
+    int ret = 0;
+
+    if (output_bin_open(output, palette->name, ".bin", &fds))
+    {
+        return -1;
+    }
+
+    if (output->palette_sizes)
+    {
+        uint16_t size = palette->nr_entries * 2;
+        uint8_t bytes[2] = { size & 255, (size >> 8) & 255 };
+
+        ret |= output_bin_array(output, bytes, sizeof bytes, fds);
+    }
+
+    for (i = 0; i < palette->nr_entries; ++i)
+    {
+        uint16_t target = palette->entries[i].target;
+        uint8_t bytes[2] = { target & 255, (target >> 8) & 255 };
+
+        ret |= output_bin_array(output, bytes, sizeof bytes, fds);
+    }
+
+    output_bin_close(fds);
+
+    return ret ? -1 : 0;
+}
+
+/* compresses the solid stream and writes the entry offsets into its output */
+static int output_bin_solid_write(struct output *output, const char *name)
+{
+    compress_mode_t mode = output->compress;
+    size_t size = output->solid_size;
+    uint8_t *data = NULL;
+    char *source = NULL;
+    FILE *fd;
+    int ret;
+
+    LOG_INFO(" - Compressing %u entries\n", output->nr_solid_entries);
+
+    data = compress_array(output->solid_data, &size, &mode, 0, 0, &output->solid_stats);
+    if (data == NULL)
+    {
+        LOG_ERROR("Failed to compress binary data.\n");
+        goto error;
+    }
 
-    source = strings_concat(output->directory, palette->name, ".bin", 0);
+    source = strings_concat(name, ".bin", 0);
     if (source == NULL)
     {
         goto error;
@@ -151,37 +301,61 @@ int output_bin_palette(struct output *output, const struct palette *palette)
 
     LOG_INFO(" - Writing \'%s\'\n", source);
 
-    fds = clean_fopen(source, "wb");
-    if (fds == NULL)
+    fd = clean_fopen(source, "wb");
+    if (fd == NULL)
     {
         LOG_ERROR("Could not open file: %s\n", strerror(errno));
         goto error;
     }
 
-    if (output->palette_sizes)
+    ret = output_bin_array(output, data, size, fd);
+
+    fclose(fd);
+
+    free(source);
+    source = NULL;
+
+    if (ret)
     {
-        uint16_t size = palette->nr_entries * 2;
+        goto error;
+    }
 
-        fputc(size & 255, fds);
-        fputc((size >> 8) & 255, fds);
+    source = strings_concat(name, "_offsets.bin", 0);
+    if (source == NULL)
+    {
+        goto error;
     }
 
-    for (i = 0; i < palette->nr_entries; ++i)
+    LOG_INFO(" - Writing \'%s\'\n", source);
+
+    fd = clean_fopen(source, "wb");
+    if (fd == NULL)
     {
-        uint16_t target = palette->entries[i].target;
+        LOG_ERROR("Could not open file: %s\n", strerror(errno));
+        goto error;
+    }
 
-        fputc(target & 255, fds);
-        fputc((target >> 8) & 255, fds);
+    /* the final offset is the decompressed size */
+    for (uint32_t i = 0; i <= output->nr_solid_entries; ++i)
+    {
+        uint32_t offset = i < output->nr_solid_entries ?
+            output->solid_offsets[i] : output->solid_size;
+
+        fputc(offset & 255, fd);
+        fputc((offset >> 8) & 255, fd);
+        fputc((offset >> 16) & 255, fd);
     }
 
-    fclose(fds);
+    fclose(fd);
 
     free(source);
+    free(data);
 
     return 0;
 
 error:
     free(source);
+    free(data);
     return -1;
 }
 
@@ -202,12 +376,20 @@ int output_bin_include(struct output *output)
         goto error;
     }
 
-    tmp = strchr(include_name, '.');
-    if (tmp != NULL)
+    tmp = strrchr(include_name, '.');
+    if (tmp != NULL && strchr(tmp, '/') == NULL)
     {
         *tmp = '\0';
     }
 
+    if (output_bin_solid(output) && output->solid_size != 0)
+    {
+        if (output_bin_solid_write(output, include_name))
+        {
+            goto error;
+        }
+    }
+
     LOG_INFO(" - Writing \'%s\'\n", output->include_file);
 
     fdi = clean_fopen(output->include_file, "wt");
@@ -217,6 +399,24 @@ int output_bin_include(struct output *output)
         goto error;
     }
 
+    if (output_bin_solid(output))
+    {
+        tmp = strrchr(include_name, '/');
+        tmp = tmp != NULL ? tmp + 1 : include_name;
+
+        if (output->solid_size != 0)
+        {
+            fprintf(fdi, "%s.bin\n", tmp);
+            fprintf(fdi, "%s_offsets.bin\n", tmp);
+        }
+
+        fclose(fdi);
+
+        free(include_name);
+
+        return 0;
+    }
+
     for (uint32_t i = 0; i < output->nr_palettes; ++i)
     {
         fprintf(fdi, "%s.bin\n", output->palettes[i]->name);
@@ -238,6 +438,16 @@ int output_bin_include(struct output *output)
             const struct tileset *tileset = &convert->tilesets[k];
 
             fprintf(fdi, "%s.bin\n", tileset->image.name);
+
+            if (tileset->tile_map != NULL)
+            {
+                fprintf(fdi, "%s_tile_map.bin\n", tileset->image.name);
+            }
+
+            if (tileset->tile_transforms != NULL)
+            {
+                fprintf(fdi, "%s_tile_transforms.bin\n", tileset->image.name);
+            }
         }
     }
 
@@ -254,7 +464,14 @@ error:
 
 int output_bin_init(struct output *output)
 {
-    (void)output;
-    
+    for (uint32_t i = 0; output_bin_solid(output) && i < output->nr_converts; ++i)
+    {
+        if (output->converts[i]->compress != COMPRESS_NONE)
+        {
+            LOG_WARNING("Convert \'%s\' is compressed twice by a compressed bin output.\n",
+                output->converts[i]->name);
+        }
+    }
+
     return 0;
 }
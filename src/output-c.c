@@ -64,6 +64,7 @@ static int output_c_array(unsigned char *arr, uint32_t size, FILE *fdo)
 
 int output_c_image(struct output *output, const struct image *image)
 {
+    bool in_place = output->in_place && image->compressed && compress_mode_in_place(image->compression);
     char *header = NULL;
     char *source = NULL;
     FILE *fdh;
@@ -104,11 +105,42 @@ int output_c_image(struct output *output, const struct image *image)
     if (image->compressed)
     {
         fprintf(fdh, "#define %s_compressed_size %u\n", image->name, image->data_size);
-        fprintf(fdh, "extern %sunsigned char %s_compressed[%u];\n",
-            output->constant, image->name, image->data_size);
+        fprintf(fdh, "#define %s_compression %u\n", image->name, image->compression);
+
+        if (compress_mode_in_place(image->compression))
+        {
+            fprintf(fdh, "#define %s_decompress_delta %u\n", image->name, image->decompress_delta);
+        }
+
+        if (in_place)
+        {
+            /* the buffer is written by decompression, so it is never const */
+            if (image->gfx)
+            {
+                fprintf(fdh, "#define %s ((%s*)%s_data)\n",
+                    image->name,
+                    image->rlet ? "gfx_rletsprite_t" : "gfx_sprite_t",
+                    image->name);
+            }
+
+            fprintf(fdh, "#define %s_compressed (%s_data + %u)\n",
+                image->name, image->name, image_in_place_size(image) - image->data_size);
+            fprintf(fdh, "extern unsigned char %s_data[%u];\n",
+                image->name, image_in_place_size(image));
+        }
+        else
+        {
+            fprintf(fdh, "extern %sunsigned char %s_compressed[%u];\n",
+                output->constant, image->name, image->data_size);
+        }
     }
     else
     {
+        if (image->stored)
+        {
+            fprintf(fdh, "#define %s_compression %u\n", image->name, image->compression);
+        }
+
         if (image->gfx)
         {
             fprintf(fdh, "#define %s ((%s%s*)%s_data)\n",
@@ -140,7 +172,12 @@ int output_c_image(struct output *output, const struct image *image)
         goto error;
     }
 
-    if (image->compressed)
+    if (in_place)
+    {
+        fprintf(fds, "unsigned char %s_data[%u] =\n{\n    [%u] =",
+            image->name, image_in_place_size(image), image_in_place_size(image) - image->data_size);
+    }
+    else if (image->compressed)
     {
         fprintf(fds, "%sunsigned char %s_compressed[%u] =\n{",
             output->constant, image->name, image->data_size);
@@ -166,6 +203,27 @@ error:
     return -1;
 }
 
+static void output_c_tileset_compression(const struct tileset *tileset, FILE *fdh)
+{
+    compress_mode_t mode = tileset_compression(tileset);
+
+    if (mode != COMPRESS_BEST)
+    {
+        fprintf(fdh, "#define %s_compression %u\n",
+            tileset->image.name,
+            mode);
+        return;
+    }
+
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        fprintf(fdh, "#define %s_tile_%u_compression %u\n",
+            tileset->image.name,
+            i,
+            tileset->tiles[i].compression);
+    }
+}
+
 int output_c_tileset(struct output *output, const struct tileset *tileset)
 {
     char *header = NULL;
@@ -239,6 +297,48 @@ int output_c_tileset(struct output *output, const struct tileset *tileset)
         tileset->image.name,
         tileset->nr_tiles);
 
+    if (tileset->compressed || tileset->stored)
+    {
+        uint32_t delta;
+
+        output_c_tileset_compression(tileset, fdh);
+
+        if (tileset_decompress_delta(tileset, &delta))
+        {
+            fprintf(fdh, "#define %s_decompress_delta %u\n",
+                tileset->image.name,
+                delta);
+        }
+    }
+
+    if (tileset->tile_map != NULL)
+    {
+        fprintf(fdh, "#define %s_num_tile_map_entries %u\n",
+            tileset->image.name,
+            tileset->nr_tile_map_entries);
+        fprintf(fdh, "#define %s_tile_map_entry_size %u\n",
+            tileset->image.name,
+            tileset->tile_map_entry_size);
+        fprintf(fdh, "#define %s_tile_map_width %u\n",
+            tileset->image.name,
+            tileset->tile_map_width);
+        fprintf(fdh, "#define %s_tile_map_height %u\n",
+            tileset->image.name,
+            tileset->tile_map_height);
+        fprintf(fdh, "extern %sunsigned char %s_tile_map[%u];\n",
+            output->constant,
+            tileset->image.name,
+            tileset->tile_map_size);
+    }
+
+    if (tileset->tile_transforms != NULL)
+    {
+        fprintf(fdh, "extern %sunsigned char %s_tile_transforms[%u];\n",
+            output->constant,
+            tileset->image.name,
+            tileset->nr_tile_map_entries);
+    }
+
     if (tileset->p_table)
     {
         if (tileset->compressed)
@@ -308,6 +408,26 @@ int output_c_tileset(struct output *output, const struct tileset *tileset)
         output_c_array(tile->data, tile->data_size, fds);
     }
 
+    if (tileset->tile_map != NULL)
+    {
+        fprintf(fds, "%sunsigned char %s_tile_map[%u] =\n{",
+            output->constant,
+            tileset->image.name,
+            tileset->tile_map_size);
+
+        output_c_array(tileset->tile_map, tileset->tile_map_size, fds);
+    }
+
+    if (tileset->tile_transforms != NULL)
+    {
+        fprintf(fds, "%sunsigned char %s_tile_transforms[%u] =\n{",
+            output->constant,
+            tileset->image.name,
+            tileset->nr_tile_map_entries);
+
+        output_c_array(tileset->tile_transforms, tileset->nr_tile_map_entries, fds);
+    }
+
     if (tileset->p_table)
     {
         if (tileset->compressed)
@@ -71,6 +71,7 @@ int output_appvar_image(struct output *output, const struct image *image);
 int output_appvar_tileset(struct output *output, const struct tileset *tileset);
 int output_appvar_palette(struct output *output, const struct palette *palette);
 int output_appvar_include(struct output *output);
+int output_appvar_compress_blocks(struct output *output);
 
 struct output *output_alloc(void)
 {
@@ -89,6 +90,7 @@ struct output *output_alloc(void)
     output->palettes = NULL;
     output->nr_palettes = 0;
     output->palette_sizes = false;
+    output->in_place = false;
     output->order = OUTPUT_PALETTES_FIRST;
     output->format = OUTPUT_FORMAT_INVALID;
     output->constant = "";
@@ -96,12 +98,28 @@ struct output *output_alloc(void)
     output->appvar.init = true;
     output->appvar.source = APPVAR_SOURCE_NONE;
     output->appvar.compress = COMPRESS_NONE;
+    output->appvar.compression = COMPRESS_NONE;
+    output->appvar.compress_min_gain = 0;
+    output->appvar.compress_tolerance = 0;
+    output->appvar.decompress_delta = 0;
+    memset(&output->appvar.compress_stats, 0, sizeof output->appvar.compress_stats);
+    output->appvar.block_size = 0;
+    output->appvar.nr_blocks = 0;
     output->appvar.size = 0;
     output->appvar.lut = false;
     output->appvar.header = NULL;
     output->appvar.header_size = 0;
     output->appvar.entry_size = 3;
     output->appvar.data = NULL;
+    output->stream_convert = 0;
+    output->stream_item = 0;
+    output->blocks = NULL;
+    output->compress = COMPRESS_NONE;
+    output->solid_data = NULL;
+    output->solid_size = 0;
+    output->solid_offsets = NULL;
+    output->nr_solid_entries = 0;
+    memset(&output->solid_stats, 0, sizeof output->solid_stats);
 
     memset(output->appvar.comment, 0, APPVAR_MAX_COMMENT_SIZE + 1);
     memset(output->appvar.name, 0, APPVAR_MAX_NAME_SIZE + 1);
@@ -201,6 +219,19 @@ void output_free(struct output *output)
     free(output->appvar.data);
     output->appvar.data = NULL;
 
+    for (uint32_t i = 0; output->blocks != NULL && i < output->appvar.nr_blocks; ++i)
+    {
+        free(output->blocks[i].data);
+    }
+    free(output->blocks);
+    output->blocks = NULL;
+
+    free(output->solid_data);
+    output->solid_data = NULL;
+
+    free(output->solid_offsets);
+    output->solid_offsets = NULL;
+
     free(output->converts);
     output->converts = NULL;
 
@@ -419,6 +450,19 @@ static bool output_include(void *arg)
     }
 }
 
+/* appvar blocks compress across the pool and the last one writes the output */
+static int output_finish(struct output *output)
+{
+    if (output->format == OUTPUT_FORMAT_APPVAR &&
+        output->appvar.block_size != 0 &&
+        (output->nr_palettes != 0 || output->nr_converts != 0))
+    {
+        return output_appvar_compress_blocks(output);
+    }
+
+    return thread_start(output_include, output) ? 0 : -1;
+}
+
 static int output_converts(struct output *output)
 {
     for (uint32_t i = 0; i < output->nr_converts; ++i)
@@ -516,10 +560,234 @@ int output_generate(struct output *output,
         }
     }
 
-    if (!thread_start(output_include, output))
+    if (output_finish(output))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static struct
+{
+    struct output **outputs;
+    uint32_t nr_outputs;
+    mtx_t mtx;
+} output_stream;
+
+/* writes the next converted items of an output in order */
+static int output_stream_advance(struct output *output)
+{
+    while (output->stream_convert < output->nr_converts)
+    {
+        struct convert *convert = output->converts[output->stream_convert];
+        uint32_t item = output->stream_item;
+
+        if (item < convert->nr_images)
+        {
+            struct image *image = &convert->images[item];
+
+            if (!image->converted)
+            {
+                return 0;
+            }
+
+            if (item == 0)
+            {
+                LOG_INFO("Generating output for convert \'%s\'\n",
+                    convert->name);
+            }
+
+            if (output_image(output, image))
+            {
+                return -1;
+            }
+
+            if (--image->nr_pending_outputs == 0)
+            {
+                free(image->data);
+                image->data = NULL;
+            }
+        }
+        else if (item - convert->nr_images < convert->nr_tilesets)
+        {
+            struct tileset *tileset = &convert->tilesets[item - convert->nr_images];
+
+            if (!tileset->converted)
+            {
+                return 0;
+            }
+
+            if (item == 0)
+            {
+                LOG_INFO("Generating output for convert \'%s\'\n",
+                    convert->name);
+            }
+
+            if (output_tileset(output, tileset))
+            {
+                return -1;
+            }
+
+            if (--tileset->nr_pending_outputs == 0)
+            {
+                tileset_release_tiles(tileset);
+            }
+        }
+        else
+        {
+            output->stream_convert++;
+            output->stream_item = 0;
+            continue;
+        }
+
+        output->stream_item++;
+    }
+
+    return 0;
+}
+
+static int output_stream_done(struct convert *convert, struct image *image, struct tileset *tileset)
+{
+    int ret = 0;
+
+    mtx_lock(&output_stream.mtx);
+
+    if (image != NULL)
+    {
+        image->converted = true;
+        image->nr_pending_outputs = convert->nr_output_refs;
+
+        if (image->nr_pending_outputs == 0)
+        {
+            free(image->data);
+            image->data = NULL;
+        }
+    }
+
+    if (tileset != NULL)
     {
+        /* the source pixels are no longer needed */
+        free(tileset->image.data);
+        tileset->image.data = NULL;
+
+        tileset->converted = true;
+        tileset->nr_pending_outputs = convert->nr_output_refs;
+
+        if (tileset->nr_pending_outputs == 0)
+        {
+            tileset_release_tiles(tileset);
+        }
+    }
+
+    for (uint32_t i = 0; i < output_stream.nr_outputs; ++i)
+    {
+        if (output_stream_advance(output_stream.outputs[i]))
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    mtx_unlock(&output_stream.mtx);
+
+    return ret;
+}
+
+int output_stream_begin(struct output **outputs,
+                        uint32_t nr_outputs,
+                        struct palette **palettes,
+                        uint32_t nr_palettes,
+                        struct convert **converts,
+                        uint32_t nr_converts)
+{
+    if (mtx_init(&output_stream.mtx, mtx_plain) != thrd_success)
+    {
+        LOG_ERROR("Could not create output lock.\n");
         return -1;
     }
 
+    output_stream.outputs = outputs;
+    output_stream.nr_outputs = nr_outputs;
+
+    for (uint32_t i = 0; i < nr_converts; ++i)
+    {
+        converts[i]->done = output_stream_done;
+        converts[i]->nr_output_refs = 0;
+    }
+
+    for (uint32_t i = 0; i < nr_outputs; ++i)
+    {
+        struct output *output = outputs[i];
+
+        if (output_find_palettes(output, palettes, nr_palettes))
+        {
+            return -1;
+        }
+
+        if (output_find_converts(output, converts, nr_converts))
+        {
+            return -1;
+        }
+
+        if (output_init(output))
+        {
+            return -1;
+        }
+
+        if (output->order == OUTPUT_PALETTES_FIRST)
+        {
+            if (output_palettes(output))
+            {
+                return -1;
+            }
+        }
+
+        /* each reference writes the data once before it can be freed */
+        for (uint32_t j = 0; j < output->nr_converts; ++j)
+        {
+            output->converts[j]->nr_output_refs++;
+        }
+
+        output->stream_convert = 0;
+        output->stream_item = 0;
+    }
+
+    return 0;
+}
+
+int output_stream_end(void)
+{
+    for (uint32_t i = 0; i < output_stream.nr_outputs; ++i)
+    {
+        struct output *output = output_stream.outputs[i];
+
+        if (output_stream_advance(output))
+        {
+            return -1;
+        }
+
+        if (output->stream_convert != output->nr_converts)
+        {
+            LOG_ERROR("Output is missing converted data.\n");
+            return -1;
+        }
+
+        if (output->order != OUTPUT_PALETTES_FIRST)
+        {
+            if (output_palettes(output))
+            {
+                return -1;
+            }
+        }
+
+        if (output_finish(output))
+        {
+            return -1;
+        }
+    }
+
+    mtx_destroy(&output_stream.mtx);
+
     return 0;
 }
@@ -36,6 +36,7 @@
 #include "palette.h"
 #include "compress.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -58,6 +59,14 @@ typedef enum
     OUTPUT_CONVERTS_FIRST,
 } output_order_t;
 
+struct output_block
+{
+    struct output *output;
+    uint8_t *data;
+    uint32_t size;
+    struct compress_stats compress_stats;
+};
+
 struct output
 {
     char *include_file;
@@ -71,9 +80,25 @@ struct output
     output_format_t format;
     const char *constant;
     bool palette_sizes;
+    bool in_place;
     compress_mode_t compress;
     struct appvar appvar;
     output_order_t order;
+
+    /* next item to write when streaming */
+    uint32_t stream_convert;
+    uint32_t stream_item;
+
+    /* appvar blocks still compressing */
+    struct output_block *blocks;
+    atomic_uint nr_pending_blocks;
+
+    /* bin entries packed into one stream when compressed */
+    uint8_t *solid_data;
+    uint32_t solid_size;
+    uint32_t *solid_offsets;
+    uint32_t nr_solid_entries;
+    struct compress_stats solid_stats;
 };
 
 struct output *output_alloc(void);
@@ -92,6 +117,15 @@ int output_generate(struct output *output,
     struct convert **converts,
     uint32_t nr_converts);
 
+int output_stream_begin(struct output **outputs,
+    uint32_t nr_outputs,
+    struct palette **palettes,
+    uint32_t nr_palettes,
+    struct convert **converts,
+    uint32_t nr_converts);
+
+int output_stream_end(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -35,6 +35,7 @@
 #include "image.h"
 #include "log.h"
 #include "thread.h"
+#include "report.h"
 
 #include "deps/libimagequant/libimagequant.h"
 
@@ -70,6 +71,7 @@ struct palette *palette_alloc(void)
     palette->color_fmt = COLOR_1555_GRGB;
     palette->quantize_speed = PALETTE_DEFAULT_QUANTIZE_SPEED;
     palette->automatic = false;
+    palette->quantize_time = 0;
     palette->name = NULL;
 
     for (i = 0; i < PALETTE_MAX_ENTRIES; ++i)
@@ -102,16 +104,7 @@ static int palette_add_image(struct palette *palette, const char *path)
     image = &palette->images[palette->nr_images];
     palette->nr_images++;
 
-    image->name = strings_basename(path);
-    image->data = NULL;
-    image->width = 0;
-    image->height = 0;
-    image->rotate = 0;
-    image->flip_x = false;
-    image->flip_y = false;
-    image->rlet = false;
-
-    image->path = strings_dup(path);
+    image_init(image, path);
     if (image->path == NULL)
     {
         return -1;
@@ -181,6 +174,8 @@ void palette_free(struct palette *palette)
 
         free(image->data);
         image->path = NULL;
+
+        file_map_close(&image->map);
     }
 
     free(palette->images);
@@ -223,12 +218,26 @@ int palette_automatic_build(struct palette *palette, struct convert **converts,
 
         for (uint32_t j = 0; j < converts[i]->nr_images; ++j)
         {
+            /* sprites are covered by their sheet */
+            if (converts[i]->images[j].sheet != NULL)
+            {
+                continue;
+            }
+
             if (palette_add_image(palette, converts[i]->images[j].path))
             {
                 return -1;
             }
         }
 
+        for (uint32_t j = 0; j < convert->nr_sheets; ++j)
+        {
+            if (palette_add_image(palette, convert->sheets[j].image.path))
+            {
+                return -1;
+            }
+        }
+
         for (uint32_t j = 0; j < convert->nr_tilesets; ++j)
         {
             if (palette_add_image(palette, convert->tilesets[j].image.path))
@@ -420,11 +429,22 @@ int palette_generate_with_images(struct palette *palette)
     uint32_t *colors = memory_realloc_array(NULL, nr_colors_alloc, 4);
     uint32_t nr_colors = 0;
 
+    if (palette->nr_images != 0)
+    {
+        image_prefetch(&palette->images[0]);
+    }
+
     /* quantize the images into a palette */
     for (uint32_t i = 0; i < palette->nr_images; ++i)
     {
         struct image *image = &palette->images[i];
 
+        /* read the next image while this one is processed */
+        if (i + 1 < palette->nr_images)
+        {
+            image_prefetch(&palette->images[i + 1]);
+        }
+
         LOG_INFO(" - Reading image \'%s\'\n", image->path);
 
         if (image_load(image))
@@ -672,11 +692,19 @@ int palette_generate_with_images(struct palette *palette)
     return 0;
 }
 
-bool palette_generate_thread(void *palette)
+bool palette_generate_thread(void *arg)
 {
-    return
-        !palette_generate_with_images(palette) &&
-        !palette_convert_colors(palette);
+    struct palette *palette = arg;
+    double start = report_clock();
+
+    if (palette_generate_with_images(palette))
+    {
+        return false;
+    }
+
+    palette->quantize_time = report_clock() - start;
+
+    return !palette_convert_colors(palette);
 }
 
 int palette_generate(struct palette *palette, struct convert **converts, uint32_t nr_converts)
@@ -73,6 +73,7 @@ struct palette
     struct palette_entry fixed_entries[PALETTE_MAX_ENTRIES];
     color_format_t color_fmt;
     bool automatic;
+    double quantize_time;
 };
 
 struct palette *palette_alloc(void);
@@ -64,20 +64,16 @@ static bool parse_str_bool(void *value)
 
 static compress_mode_t parse_compression_mode(void *value)
 {
-    if (parse_str_cmp("zx7", value))
-    {
-        return COMPRESS_ZX7;
-    }
-    else if (parse_str_cmp("zx0", value))
-    {
-        return COMPRESS_ZX0;
-    }
-    else if (parse_str_cmp("lz4", value))
+    const struct compress_codec *codec;
+
+    if (parse_str_cmp("best", value))
     {
-        return COMPRESS_LZ4;
+        return COMPRESS_BEST;
     }
 
-    return COMPRESS_NONE;
+    codec = compress_codec_find(value);
+
+    return codec != NULL ? codec->mode : COMPRESS_NONE;
 }
 
 static void parser_show_mark_error(yaml_mark_t mark)
@@ -911,6 +907,26 @@ static int parse_convert_tilesets(struct convert *convert, yaml_document_t *doc,
         {
             convert->tile_flip_y = parse_str_bool(value);
         }
+        else if (parse_str_cmp("tilemap", key))
+        {
+            convert->tilemap = parse_str_bool(value);
+        }
+        else if (parse_str_cmp("quantize-once", key))
+        {
+            convert->tile_quantize_once = parse_str_bool(value);
+        }
+        else if (parse_str_cmp("deduplicate", key))
+        {
+            if (parse_str_cmp("symmetric", value))
+            {
+                convert->tile_deduplicate = TILESET_DEDUPLICATE_SYMMETRIC;
+            }
+            else
+            {
+                convert->tile_deduplicate = parse_str_bool(value) ?
+                    TILESET_DEDUPLICATE_EXACT : TILESET_DEDUPLICATE_NONE;
+            }
+        }
         else if (parse_str_cmp("images", key))
         {
             if (parse_convert_tilesets_images(convert, doc, valuen))
@@ -929,6 +945,218 @@ static int parse_convert_tilesets(struct convert *convert, yaml_document_t *doc,
     return 0;
 }
 
+static int parse_sheet_sprite(struct sheet *sheet, yaml_document_t *doc, yaml_node_t *root)
+{
+    yaml_node_pair_t *pair;
+    const char *name = NULL;
+    long x = -1;
+    long y = -1;
+    long width = -1;
+    long height = -1;
+
+    if (root->type != YAML_MAPPING_NODE)
+    {
+        LOG_ERROR("Unknown sheet sprite.\n");
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    pair = root->data.mapping.pairs.start;
+    for (; pair < root->data.mapping.pairs.top; ++pair)
+    {
+        yaml_node_t *keyn = yaml_document_get_node(doc, pair->key);
+        yaml_node_t *valuen = yaml_document_get_node(doc, pair->value);
+        char *key;
+        char *value;
+
+        if (keyn == NULL || valuen == NULL)
+        {
+            continue;
+        }
+
+        key = (char*)keyn->data.scalar.value;
+        value = (char*)valuen->data.scalar.value;
+
+        if (parse_str_cmp("name", key))
+        {
+            name = value;
+        }
+        else if (parse_str_cmp("x", key))
+        {
+            x = strtol(value, NULL, 0);
+        }
+        else if (parse_str_cmp("y", key))
+        {
+            y = strtol(value, NULL, 0);
+        }
+        else if (parse_str_cmp("width", key))
+        {
+            width = strtol(value, NULL, 0);
+        }
+        else if (parse_str_cmp("height", key))
+        {
+            height = strtol(value, NULL, 0);
+        }
+        else
+        {
+            LOG_ERROR("Unknown sprite option: \'%s\'\n", key);
+            parser_show_mark_error(keyn->start_mark);
+            return -1;
+        }
+    }
+
+    if (name == NULL || x < 0 || y < 0 || width < 1 || height < 1)
+    {
+        LOG_ERROR("Sprite needs a name, x, y, width, and height.\n");
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    return sheet_add_sprite(sheet, strings_trim((char *)name), x, y, width, height);
+}
+
+static int parse_convert_sheet(struct convert *convert, yaml_document_t *doc, yaml_node_t *root)
+{
+    struct sheet *sheet = NULL;
+    yaml_node_pair_t *pair;
+
+    if (root->type != YAML_MAPPING_NODE)
+    {
+        LOG_ERROR("Unknown sheet options.\n");
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    /* the sheet image is needed before its sprites */
+    pair = root->data.mapping.pairs.start;
+    for (; pair < root->data.mapping.pairs.top; ++pair)
+    {
+        yaml_node_t *keyn = yaml_document_get_node(doc, pair->key);
+        yaml_node_t *valuen = yaml_document_get_node(doc, pair->value);
+
+        if (keyn != NULL && valuen != NULL && parse_str_cmp("image", keyn->data.scalar.value))
+        {
+            sheet = convert_add_sheet(convert, strings_trim((char*)valuen->data.scalar.value));
+            if (sheet == NULL)
+            {
+                parser_show_mark_error(valuen->start_mark);
+                return -1;
+            }
+        }
+    }
+
+    if (sheet == NULL)
+    {
+        LOG_ERROR("Sheet is missing the \'image\' option.\n");
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    pair = root->data.mapping.pairs.start;
+    for (; pair < root->data.mapping.pairs.top; ++pair)
+    {
+        yaml_node_t *keyn = yaml_document_get_node(doc, pair->key);
+        yaml_node_t *valuen = yaml_document_get_node(doc, pair->value);
+        yaml_node_item_t *item;
+        char *key;
+        char *value;
+
+        if (keyn == NULL || valuen == NULL)
+        {
+            continue;
+        }
+
+        key = (char*)keyn->data.scalar.value;
+        value = (char*)valuen->data.scalar.value;
+
+        if (parse_str_cmp("image", key))
+        {
+            continue;
+        }
+        else if (parse_str_cmp("sprite-width", key))
+        {
+            int tmpi = strtol(value, NULL, 0);
+            if (tmpi < 1)
+            {
+                LOG_ERROR("Invalid sheet sprite-width: %d\n", tmpi);
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            sheet->sprite_width = tmpi;
+        }
+        else if (parse_str_cmp("sprite-height", key))
+        {
+            int tmpi = strtol(value, NULL, 0);
+            if (tmpi < 1)
+            {
+                LOG_ERROR("Invalid sheet sprite-height: %d\n", tmpi);
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            sheet->sprite_height = tmpi;
+        }
+        else if (parse_str_cmp("sprites", key))
+        {
+            if (valuen->type != YAML_SEQUENCE_NODE)
+            {
+                LOG_ERROR("Unknown sheet sprites.\n");
+                parser_show_mark_error(valuen->start_mark);
+                return -1;
+            }
+
+            item = valuen->data.sequence.items.start;
+            for (; item < valuen->data.sequence.items.top; ++item)
+            {
+                yaml_node_t *node = yaml_document_get_node(doc, *item);
+                if (node != NULL && parse_sheet_sprite(sheet, doc, node))
+                {
+                    return -1;
+                }
+            }
+        }
+        else
+        {
+            LOG_ERROR("Unknown sheet option: \'%s\'\n", key);
+            parser_show_mark_error(keyn->start_mark);
+            return -1;
+        }
+    }
+
+    if (sheet->nr_sprites != 0 && (sheet->sprite_width || sheet->sprite_height))
+    {
+        LOG_ERROR("Sheet \'%s\' cannot use both a sprite list and a grid.\n",
+            sheet->image.path);
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_convert_sheets(struct convert *convert, yaml_document_t *doc, yaml_node_t *root)
+{
+    yaml_node_item_t *item;
+
+    if (root->type != YAML_SEQUENCE_NODE)
+    {
+        LOG_ERROR("Unknown convert sheets.\n");
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    item = root->data.sequence.items.start;
+    for (; item < root->data.sequence.items.top; ++item)
+    {
+        yaml_node_t *node = yaml_document_get_node(doc, *item);
+        if (node != NULL && parse_convert_sheet(convert, doc, node))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static int parse_convert(struct yaml *data, yaml_document_t *doc, yaml_node_t *root)
 {
     struct convert *convert = NULL;
@@ -1045,6 +1273,28 @@ static int parse_convert(struct yaml *data, yaml_document_t *doc, yaml_node_t *r
                 return -1;
             }
         }
+        else if (parse_str_cmp("compress-min-gain", key))
+        {
+            tmpi = strtol(value, NULL, 10);
+            if (tmpi < 0 || tmpi > COMPRESS_MAX_MIN_GAIN)
+            {
+                LOG_ERROR("Invalid compression minimum gain.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            convert->compress_min_gain = tmpi;
+        }
+        else if (parse_str_cmp("compress-tolerance", key))
+        {
+            tmpi = strtol(value, NULL, 10);
+            if (tmpi < 0 || tmpi > COMPRESS_MAX_TOLERANCE)
+            {
+                LOG_ERROR("Invalid compression tolerance.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            convert->compress_tolerance = tmpi;
+        }
         else if (parse_str_cmp("dither", key))
         {
             float tmpf = strtof(value, NULL);
@@ -1170,6 +1420,13 @@ static int parse_convert(struct yaml *data, yaml_document_t *doc, yaml_node_t *r
                 return -1;
             }
         }
+        else if (parse_str_cmp("sheets", key))
+        {
+            if (parse_convert_sheets(convert, doc, valuen))
+            {
+                return -1;
+            }
+        }
         else if (parse_str_cmp("prefix", key))
         {
             convert->prefix_string = strings_dup(value);
@@ -1333,6 +1590,21 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
         {
             output->constant = parse_str_bool(value) ? "const " : "";
         }
+        else if (parse_str_cmp("decompress-in-place", key))
+        {
+            output->in_place = parse_str_bool(value);
+        }
+        else if (output->format == OUTPUT_FORMAT_BIN && parse_str_cmp("compress", key))
+        {
+            /* the stream has no header to record a chosen codec */
+            output->compress = parse_compression_mode(value);
+            if (output->compress == COMPRESS_NONE || output->compress == COMPRESS_BEST)
+            {
+                LOG_ERROR("Invalid compression mode.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+        }
         else
         {
             if (output->format != OUTPUT_FORMAT_APPVAR)
@@ -1403,6 +1675,39 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
                     return -1;
                 }
             }
+            else if (parse_str_cmp("compress-block-size", key))
+            {
+                int tmpi = strtol(value, NULL, 0);
+                if (tmpi <= 0 || tmpi > APPVAR_MAX_BLOCK_SIZE)
+                {
+                    LOG_ERROR("Invalid compression block size.\n");
+                    parser_show_mark_error(keyn->start_mark);
+                    return -1;
+                }
+                output->appvar.block_size = tmpi;
+            }
+            else if (parse_str_cmp("compress-min-gain", key))
+            {
+                int tmpi = strtol(value, NULL, 10);
+                if (tmpi < 0 || tmpi > COMPRESS_MAX_MIN_GAIN)
+                {
+                    LOG_ERROR("Invalid compression minimum gain.\n");
+                    parser_show_mark_error(keyn->start_mark);
+                    return -1;
+                }
+                output->appvar.compress_min_gain = tmpi;
+            }
+            else if (parse_str_cmp("compress-tolerance", key))
+            {
+                int tmpi = strtol(value, NULL, 10);
+                if (tmpi < 0 || tmpi > COMPRESS_MAX_TOLERANCE)
+                {
+                    LOG_ERROR("Invalid compression tolerance.\n");
+                    parser_show_mark_error(keyn->start_mark);
+                    return -1;
+                }
+                output->appvar.compress_tolerance = tmpi;
+            }
             else if (parse_str_cmp("comment", key))
             {
                 strncpy(output->appvar.comment, value, APPVAR_MAX_COMMENT_SIZE);
@@ -1581,6 +1886,22 @@ static int parser_validate(struct yaml *yaml)
                     convert->name);
                 return -1;
             }
+            if (convert->bpp != BPP_8)
+            {
+                /* packing needs fixed length rows */
+                if (convert->style == CONVERT_STYLE_RLET)
+                {
+                    LOG_ERROR("Convert \'%s\' style does not support \'bpp\' option.\n",
+                        convert->name);
+                    return -1;
+                }
+                if (convert->nr_omit_indices)
+                {
+                    LOG_ERROR("Convert \'%s\' \'bpp\' option does not support \'omit-indices\' option.\n",
+                        convert->name);
+                    return -1;
+                }
+            }
         }
     }
 
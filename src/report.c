@@ -0,0 +1,236 @@
+/*
+ * Copyright 2017-2026 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "report.h"
+#include "parser.h"
+#include "tileset.h"
+#include "log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+double report_clock(void)
+{
+    struct timespec ts;
+
+    if (timespec_get(&ts, TIME_UTC) == 0)
+    {
+        return 0;
+    }
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report_string(FILE *fd, const char *str)
+{
+    fputc('\"', fd);
+
+    for (; str != NULL && *str != '\0'; ++str)
+    {
+        unsigned char c = *str;
+
+        if (c == '\"' || c == '\\')
+        {
+            fprintf(fd, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(fd, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, fd);
+        }
+    }
+
+    fputc('\"', fd);
+}
+
+static void report_compression(FILE *fd, compress_mode_t mode, const struct compress_stats *stats)
+{
+    bool first = true;
+
+    fprintf(fd, "\"compression\": \"%s\", \"codecs\": {", compress_mode_name(mode));
+
+    for (compress_mode_t i = COMPRESS_NONE + 1; i < COMPRESS_BEST; ++i)
+    {
+        if (stats->sizes[i] == 0)
+        {
+            continue;
+        }
+
+        fprintf(fd, "%s\"%s\": %u", first ? "" : ", ", compress_mode_name(i), stats->sizes[i]);
+        first = false;
+    }
+
+    fprintf(fd, "}, \"estimated_size\": %u, \"compress_time\": %.6f", stats->estimate, stats->time);
+}
+
+static void report_image(FILE *fd, const struct image *image)
+{
+    fprintf(fd, "        {\"name\": ");
+    report_string(fd, image->name);
+    fprintf(fd, ", \"width\": %u, \"height\": %u", image->width, image->height);
+    fprintf(fd, ", \"raw_size\": %u", image->width * image->height * 4);
+    fprintf(fd, ", \"converted_size\": %u", image->converted_size);
+    fprintf(fd, ", \"encoded_size\": %u", image->uncompressed_size);
+    fprintf(fd, ", \"size\": %u", image->data_size);
+    fprintf(fd, ", \"quantize_time\": %.6f, ", image->quantize_time);
+    report_compression(fd, image->compression, &image->compress_stats);
+    fprintf(fd, "}");
+}
+
+static void report_tileset(FILE *fd, const struct tileset *tileset)
+{
+    fprintf(fd, "        {\"name\": ");
+    report_string(fd, tileset->image.name);
+    fprintf(fd, ", \"tile_width\": %u, \"tile_height\": %u",
+        tileset->tile_width,
+        tileset->tile_height);
+    fprintf(fd, ", \"quantize_time\": %.6f", tileset->image.quantize_time);
+    fprintf(fd, ", \"tiles\": [\n");
+
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        const struct tileset_tile *tile = &tileset->tiles[i];
+
+        fprintf(fd, "          {\"index\": %u", i);
+        fprintf(fd, ", \"raw_size\": %u", tileset->tile_width * tileset->tile_height * 4);
+        fprintf(fd, ", \"converted_size\": %u", tile->converted_size);
+        fprintf(fd, ", \"encoded_size\": %u", tile->uncompressed_size);
+        fprintf(fd, ", \"size\": %u", tile->data_size);
+        fprintf(fd, ", \"quantize_time\": %.6f, ", tile->quantize_time);
+        report_compression(fd, tile->compression, &tile->compress_stats);
+        fprintf(fd, "}%s\n", i + 1 < tileset->nr_tiles ? "," : "");
+    }
+
+    fprintf(fd, "        ]}");
+}
+
+static void report_convert(FILE *fd, const struct convert *convert)
+{
+    fprintf(fd, "    {\"name\": ");
+    report_string(fd, convert->name);
+    fprintf(fd, ",\n      \"images\": [\n");
+
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        report_image(fd, &convert->images[i]);
+        fprintf(fd, "%s\n", i + 1 < convert->nr_images ? "," : "");
+    }
+
+    fprintf(fd, "      ],\n      \"tilesets\": [\n");
+
+    for (uint32_t i = 0; i < convert->nr_tilesets; ++i)
+    {
+        report_tileset(fd, &convert->tilesets[i]);
+        fprintf(fd, "%s\n", i + 1 < convert->nr_tilesets ? "," : "");
+    }
+
+    fprintf(fd, "      ]}");
+}
+
+static void report_appvar(FILE *fd, const struct appvar *appvar)
+{
+    fprintf(fd, "    {\"name\": ");
+    report_string(fd, appvar->name);
+    fprintf(fd, ", \"encoded_size\": %u", appvar->uncompressed_size);
+    fprintf(fd, ", \"size\": %u", appvar->size);
+    fprintf(fd, ", \"blocks\": %u, ", appvar->nr_blocks);
+    report_compression(fd, appvar->compression, &appvar->compress_stats);
+    fprintf(fd, "}");
+}
+
+int report_write(const struct yaml *yaml, const char *path)
+{
+    bool first;
+    FILE *fd;
+
+    LOG_INFO("Writing report \'%s\'\n", path);
+
+    fd = fopen(path, "wt");
+    if (fd == NULL)
+    {
+        LOG_ERROR("Could not open file: %s\n", strerror(errno));
+        return -1;
+    }
+
+    fprintf(fd, "{\n  \"palettes\": [\n");
+
+    for (uint32_t i = 0; i < yaml->nr_palettes; ++i)
+    {
+        const struct palette *palette = yaml->palettes[i];
+
+        fprintf(fd, "    {\"name\": ");
+        report_string(fd, palette->name);
+        fprintf(fd, ", \"entries\": %u, \"size\": %u, \"quantize_time\": %.6f}%s\n",
+            palette->nr_entries,
+            palette->nr_entries * 2,
+            palette->quantize_time,
+            i + 1 < yaml->nr_palettes ? "," : "");
+    }
+
+    fprintf(fd, "  ],\n  \"converts\": [\n");
+
+    for (uint32_t i = 0; i < yaml->nr_converts; ++i)
+    {
+        report_convert(fd, yaml->converts[i]);
+        fprintf(fd, "%s\n", i + 1 < yaml->nr_converts ? "," : "");
+    }
+
+    fprintf(fd, "  ],\n  \"appvars\": [\n");
+
+    first = true;
+
+    for (uint32_t i = 0; i < yaml->nr_outputs; ++i)
+    {
+        const struct output *output = yaml->outputs[i];
+
+        if (output->format != OUTPUT_FORMAT_APPVAR)
+        {
+            continue;
+        }
+
+        fprintf(fd, "%s", first ? "" : ",\n");
+        report_appvar(fd, &output->appvar);
+        first = false;
+    }
+
+    fprintf(fd, "%s  ]\n}\n", first ? "" : "\n");
+
+    if (fclose(fd))
+    {
+        LOG_ERROR("Could not write report: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
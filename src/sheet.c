@@ -0,0 +1,210 @@
+/*
+ * Copyright 2017-2026 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sheet.h"
+#include "cpu.h"
+#include "memory.h"
+#include "strings.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int sheet_add_sprite(struct sheet *sheet,
+                     const char *name,
+                     uint32_t x,
+                     uint32_t y,
+                     uint32_t width,
+                     uint32_t height)
+{
+    struct sheet_sprite *sprite;
+
+    sheet->sprites = memory_realloc_array(sheet->sprites, sheet->nr_sprites + 1, sizeof(struct sheet_sprite));
+    if (sheet->sprites == NULL)
+    {
+        return -1;
+    }
+
+    sprite = &sheet->sprites[sheet->nr_sprites];
+    sheet->nr_sprites++;
+
+    sprite->name = strings_dup(name);
+    sprite->x = x;
+    sprite->y = y;
+    sprite->width = width;
+    sprite->height = height;
+
+    return sprite->name == NULL ? -1 : 0;
+}
+
+/* splits a probed sheet into uniform sprites, numbered left to right */
+int sheet_build_grid(struct sheet *sheet)
+{
+    uint32_t nr_sprites = 0;
+
+    if (sheet->image.width % sheet->sprite_width ||
+        sheet->image.height % sheet->sprite_height)
+    {
+        LOG_ERROR("Sheet \'%s\' dimensions do not support sprite width or height.\n",
+            sheet->image.path);
+        return -1;
+    }
+
+    for (uint32_t y = 0; y < sheet->image.height; y += sheet->sprite_height)
+    {
+        for (uint32_t x = 0; x < sheet->image.width; x += sheet->sprite_width)
+        {
+            char name[32];
+            char *tmp;
+            int ret;
+
+            snprintf(name, sizeof name, "_%u", nr_sprites);
+
+            tmp = strings_concat(sheet->image.name, name, 0);
+            if (tmp == NULL)
+            {
+                return -1;
+            }
+
+            ret = sheet_add_sprite(sheet, tmp, x, y, sheet->sprite_width, sheet->sprite_height);
+            free(tmp);
+            if (ret)
+            {
+                return -1;
+            }
+
+            nr_sprites++;
+        }
+    }
+
+    return 0;
+}
+
+/* decodes the sheet once for all of its sprites */
+int sheet_load(struct sheet *sheet, bool clamp_alpha)
+{
+    LOG_INFO(" - Reading sheet \'%s\'\n", sheet->image.path);
+
+    if (image_load(&sheet->image))
+    {
+        return -1;
+    }
+
+    /* done here so sprites can share the pixels without writing them */
+    if (clamp_alpha && cpu_kernels.clamp_alpha(sheet->image.data,
+            sheet->image.width * sheet->image.height))
+    {
+        LOG_WARNING("Partially transparent pixels were rounded to fully transparent or fully opaque.\n");
+        LOG_WARNING("This may result in incorrect image conversion.\n");
+    }
+
+    sheet->nr_pending = sheet->nr_sprites;
+
+    if (sheet->nr_pending == 0)
+    {
+        free(sheet->image.data);
+        sheet->image.data = NULL;
+    }
+
+    return 0;
+}
+
+/* points a sprite at its rectangle, copying only when it is transformed */
+int sheet_extract(struct image *image)
+{
+    const struct image *src = &image->sheet->image;
+    const uint8_t *origin = src->data + (((image->sheet_y * src->width) + image->sheet_x) * 4);
+    uint32_t width = image->width;
+    uint32_t height = image->height;
+    uint32_t *data;
+
+    if (image->rotate == 90 || image->rotate == 270)
+    {
+        width = image->height;
+        height = image->width;
+    }
+
+    if (image->rotate == 0 && !image->flip_x && !image->flip_y)
+    {
+        image->data = (uint8_t *)origin;
+        image->stride = src->width;
+        image->width = width;
+        image->height = height;
+        image->data_size = 0;
+        return 0;
+    }
+
+    data = memory_arena_alloc(width * height * sizeof(uint32_t));
+    if (data == NULL)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < height; ++i)
+    {
+        memcpy(&data[i * width], origin + (i * src->width * 4), width * sizeof(uint32_t));
+    }
+
+    image->stride = 0;
+    image->data_size = 0;
+
+    if (image_orient(image, data, width, height))
+    {
+        memory_arena_free(data);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* frees the decoded sheet once its last sprite is converted */
+void sheet_release(struct sheet *sheet)
+{
+    if (atomic_fetch_sub(&sheet->nr_pending, 1) == 1)
+    {
+        free(sheet->image.data);
+        sheet->image.data = NULL;
+    }
+}
+
+void sheet_free(struct sheet *sheet)
+{
+    for (uint32_t i = 0; i < sheet->nr_sprites; ++i)
+    {
+        free(sheet->sprites[i].name);
+    }
+
+    free(sheet->sprites);
+    sheet->sprites = NULL;
+    sheet->nr_sprites = 0;
+
+    image_free(&sheet->image);
+}
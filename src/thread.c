@@ -43,17 +43,22 @@ struct thread
     void *args;
     thrd_t thrd;
     uint32_t id;
+    size_t footprint;
+    struct memory_arena arena;
 };
 
 static struct
 {
     struct thread thread[THREAD_MAX];
     unsigned int id[THREAD_MAX];
+    struct memory_arena inline_arena;
     atomic_bool error;
     atomic_size_t head;
     atomic_size_t tail;
     atomic_size_t count;
     atomic_size_t max_count;
+    atomic_size_t memory_used;
+    size_t memory_limit;
 } thread_pool;
 
 static void thread_pool_push(unsigned int id)
@@ -110,34 +115,73 @@ static int thread_func(void *t)
 
     LOG_DEBUG("Enter thread %u\n", thread->id);
 
+    /* the slot's arena is reused by each task that runs in it */
+    memory_arena_enter(&thread->arena);
+
     if (!thread->func(thread->args))
     {
         thread_pool.error = true;
     }
 
+    memory_arena_leave();
+
     LOG_DEBUG("Exit thread %u\n", thread->id);
 
+    thread_pool.memory_used -= thread->footprint;
+
     thread_pool_push(thread->id);
 
     return 0;
 }
 
+/* waits until the estimated footprint fits in the memory budget */
+static void thread_pool_admit(size_t footprint)
+{
+    if (thread_pool.memory_limit == 0)
+    {
+        return;
+    }
+
+    /* an oversized task still runs, but only by itself */
+    while (thread_pool.memory_used != 0 &&
+           thread_pool.memory_used + footprint > thread_pool.memory_limit)
+    {
+        thrd_yield();
+    }
+}
+
 bool thread_start(bool (*func)(void*), void *args)
+{
+    return thread_start_sized(func, args, 0);
+}
+
+bool thread_start_sized(bool (*func)(void*), void *args, size_t footprint)
 {
     if (thread_pool.max_count == 1)
     {
-        return func(args);
+        bool ret;
+
+        memory_arena_enter(&thread_pool.inline_arena);
+        ret = func(args);
+        memory_arena_leave();
+
+        return ret;
     }
     else
     {
         struct thread *thread = thread_pool_pop();
 
+        thread_pool_admit(footprint);
+
         thread->func = func;
         thread->args = args;
+        thread->footprint = footprint;
+        thread_pool.memory_used += footprint;
 
         if (thrd_create(&thread->thrd, thread_func, thread) != thrd_success)
         {
             LOG_ERROR("Could not start thread.");
+            thread_pool.memory_used -= footprint;
             thread_pool_push(thread->id);
             thread_pool.error = true;
             return false;
@@ -147,12 +191,14 @@ bool thread_start(bool (*func)(void*), void *args)
     return true;
 }
 
-void thread_pool_init(unsigned int max_count)
+void thread_pool_init(unsigned int max_count, size_t memory_limit)
 {
     for (unsigned int i = 0; i < max_count; ++i)
     {
         thread_pool_push(i);
     }
     thread_pool.max_count = max_count;
+    thread_pool.memory_limit = memory_limit;
+    thread_pool.memory_used = 0;
     thread_pool.error = false;
 }
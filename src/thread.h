@@ -47,9 +47,11 @@ extern "C" {
 
 bool thread_start(bool (*func)(void*), void *args);
 
+bool thread_start_sized(bool (*func)(void*), void *args, size_t footprint);
+
 bool thread_pool_wait(void);
 
-void thread_pool_init(unsigned int max_count);
+void thread_pool_init(unsigned int max_count, size_t memory_limit);
 
 #ifdef __cplusplus
 }
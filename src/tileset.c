@@ -35,6 +35,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+void tileset_release_tiles(struct tileset *tileset)
+{
+    /* sizes are kept for the include files */
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        free(tileset->tiles[i].data);
+        tileset->tiles[i].data = NULL;
+    }
+}
+
 void tileset_free_tiles(struct tileset *tileset)
 {
     for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
@@ -49,6 +59,18 @@ void tileset_free_tiles(struct tileset *tileset)
     free(tileset->tiles);
     tileset->tiles = NULL;
 
+    free(tileset->tile_sources);
+    tileset->tile_sources = NULL;
+
+    free(tileset->tile_map);
+    tileset->tile_map = NULL;
+
+    free(tileset->tile_transforms);
+    tileset->tile_transforms = NULL;
+
+    free(tileset->tile_hashes);
+    tileset->tile_hashes = NULL;
+
     image_free(&tileset->image);
 }
 
@@ -60,23 +82,554 @@ int tileset_alloc_tiles(struct tileset *tileset, uint32_t nr_tiles)
         return -1;
     }
 
+    /* tile data is assigned as each tile is converted */
     for (uint32_t i = 0; i < nr_tiles; ++i)
     {
-        uint32_t tile_dim = tileset->tile_width * tileset->tile_height;
-        uint32_t tile_data_size = tile_dim * sizeof(uint32_t);
-        uint8_t *tile_data;
+        tileset->tiles[i].data_size = 0;
+        tileset->tiles[i].data = NULL;
+        tileset->tiles[i].compression = COMPRESS_NONE;
+        tileset->tiles[i].decompress_delta = 0;
+        tileset->tiles[i].converted_size = 0;
+        tileset->tiles[i].uncompressed_size = 0;
+        tileset->tiles[i].quantize_time = 0;
+        memset(&tileset->tiles[i].compress_stats, 0, sizeof tileset->tiles[i].compress_stats);
+    }
+
+    tileset->nr_tiles = nr_tiles;
+
+    return 0;
+}
+
+/* best compression can pick a different codec per tile */
+compress_mode_t tileset_compression(const struct tileset *tileset)
+{
+    compress_mode_t mode = COMPRESS_NONE;
 
-        tile_data = memory_alloc(tile_data_size);
-        if (tile_data == NULL)
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        if (i != 0 && tileset->tiles[i].compression != mode)
         {
-            return -1;
+            return COMPRESS_BEST;
         }
 
-        tileset->tiles[i].data_size = tile_data_size;
-        tileset->tiles[i].data = tile_data;
+        mode = tileset->tiles[i].compression;
     }
 
-    tileset->nr_tiles = nr_tiles;
+    return mode;
+}
+
+/* one in-place buffer fits any tile, so keep the largest gap */
+bool tileset_decompress_delta(const struct tileset *tileset, uint32_t *delta)
+{
+    *delta = 0;
+
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        const struct tileset_tile *tile = &tileset->tiles[i];
+
+        if (!compress_mode_in_place(tile->compression))
+        {
+            return false;
+        }
+
+        if (tile->decompress_delta > *delta)
+        {
+            *delta = tile->decompress_delta;
+        }
+    }
+
+    return true;
+}
+
+#define TILESET_HASH_LANES 4
+#define TILESET_HASH_PRIME UINT32_C(0x9e3779b1)
+
+struct tileset_view
+{
+    const uint8_t *data;
+    uint32_t stride;
+    uint32_t width;
+    uint32_t height;
+};
+
+/* finds the pixel of a tile that lands at x, y once transformed */
+static const uint8_t *tileset_view_pixel(const struct tileset_view *view, uint8_t transform, uint32_t x, uint32_t y)
+{
+    uint32_t sx = x;
+    uint32_t sy = y;
+
+    /* undo the rotation first, it is applied last */
+    if (transform & TILESET_TILE_ROTATE_90)
+    {
+        sx = y;
+        sy = view->height - 1 - x;
+    }
+
+    if (transform & TILESET_TILE_FLIP_Y)
+    {
+        sx = view->width - 1 - sx;
+    }
+
+    if (transform & TILESET_TILE_FLIP_X)
+    {
+        sy = view->height - 1 - sy;
+    }
+
+    return view->data + (sy * view->stride) + (sx * sizeof(uint32_t));
+}
+
+/* independent lanes let the compiler vectorize each row */
+static void tileset_hash_row(uint32_t *lanes, const uint8_t *row, uint32_t width)
+{
+    uint32_t x = 0;
+
+    for (; x + TILESET_HASH_LANES <= width; x += TILESET_HASH_LANES)
+    {
+        for (uint32_t l = 0; l < TILESET_HASH_LANES; ++l)
+        {
+            uint32_t pixel;
+
+            memcpy(&pixel, row + ((x + l) * sizeof(uint32_t)), sizeof pixel);
+            lanes[l] = (lanes[l] ^ pixel) * TILESET_HASH_PRIME;
+        }
+    }
+
+    for (uint32_t l = 0; x < width; ++x, ++l)
+    {
+        uint32_t pixel;
+
+        memcpy(&pixel, row + (x * sizeof(uint32_t)), sizeof pixel);
+        lanes[l] = (lanes[l] ^ pixel) * TILESET_HASH_PRIME;
+    }
+}
+
+static uint64_t tileset_hash_tile(const struct tileset_view *view)
+{
+    uint32_t lanes[TILESET_HASH_LANES] = { 1, 2, 3, 4 };
+
+    for (uint32_t y = 0; y < view->height; ++y)
+    {
+        tileset_hash_row(lanes, view->data + (y * view->stride), view->width);
+    }
+
+    return (((uint64_t)lanes[0] << 32) | lanes[1]) ^
+        ((((uint64_t)lanes[2] << 32) | lanes[3]) * UINT64_C(0x9e3779b97f4a7c15));
+}
+
+/* hashes a flipped or rotated copy of a tile */
+static uint64_t tileset_hash_variant(const struct tileset_view *view, uint8_t transform, uint32_t *scratch)
+{
+    struct tileset_view variant =
+    {
+        .data = (const uint8_t *)scratch,
+        .stride = view->width * sizeof(uint32_t),
+        .width = view->width,
+        .height = view->height,
+    };
+
+    /* the tile is square whenever it is rotated */
+    for (uint32_t y = 0; y < view->height; ++y)
+    {
+        for (uint32_t x = 0; x < view->width; ++x)
+        {
+            memcpy(&scratch[y * view->width + x], tileset_view_pixel(view, transform, x, y), sizeof(uint32_t));
+        }
+    }
+
+    return tileset_hash_tile(&variant);
+}
+
+/* checks if transforming a matches b */
+static bool tileset_same_tile(const struct tileset_view *a, uint8_t transform, const struct tileset_view *b)
+{
+    if (transform == 0)
+    {
+        for (uint32_t y = 0; y < a->height; ++y)
+        {
+            if (memcmp(a->data + (y * a->stride), b->data + (y * b->stride), a->width * sizeof(uint32_t)))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    for (uint32_t y = 0; y < b->height; ++y)
+    {
+        const uint8_t *row = b->data + (y * b->stride);
+
+        for (uint32_t x = 0; x < b->width; ++x)
+        {
+            if (memcmp(tileset_view_pixel(a, transform, x, y), row + (x * sizeof(uint32_t)), sizeof(uint32_t)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* applies a transform to a 3x3 grid of distinct values */
+static void tileset_transform_grid(uint8_t transform, const uint32_t *src, uint32_t *dst)
+{
+    struct tileset_view view =
+    {
+        .data = (const uint8_t *)src,
+        .stride = 3 * sizeof(uint32_t),
+        .width = 3,
+        .height = 3,
+    };
+
+    for (uint32_t y = 0; y < 3; ++y)
+    {
+        for (uint32_t x = 0; x < 3; ++x)
+        {
+            memcpy(&dst[y * 3 + x], tileset_view_pixel(&view, transform, x, y), sizeof(uint32_t));
+        }
+    }
+}
+
+/* applies the tile-flip and tile-rotate options in the order convert does */
+static void tileset_orient_grid(const struct tileset *tileset, uint32_t *grid)
+{
+    uint8_t steps[3];
+    uint32_t nr_steps = 0;
+    uint32_t tmp[9];
+
+    if (tileset->tile_flip_x)
+    {
+        steps[nr_steps++] = TILESET_TILE_FLIP_X;
+    }
+
+    if (tileset->tile_flip_y)
+    {
+        steps[nr_steps++] = TILESET_TILE_FLIP_Y;
+    }
+
+    for (uint32_t i = 0; i < nr_steps; ++i)
+    {
+        tileset_transform_grid(steps[i], grid, tmp);
+        memcpy(grid, tmp, sizeof tmp);
+    }
+
+    switch (tileset->tile_rotate)
+    {
+        default:
+        case 0:
+            return;
+
+        case 90:
+            steps[0] = TILESET_TILE_ROTATE_90;
+            break;
+
+        case 180:
+            steps[0] = TILESET_TILE_FLIP_X | TILESET_TILE_FLIP_Y;
+            break;
+
+        case 270:
+            steps[0] = TILESET_TILE_ROTATE_90;
+            tileset_transform_grid(steps[0], grid, tmp);
+            memcpy(grid, tmp, sizeof tmp);
+            steps[0] = TILESET_TILE_FLIP_X | TILESET_TILE_FLIP_Y;
+            break;
+    }
+
+    tileset_transform_grid(steps[0], grid, tmp);
+    memcpy(grid, tmp, sizeof tmp);
+}
+
+/*
+ * matches are found on the source pixels, but the flags describe the
+ * converted tiles, so map each transform through the tile orientation
+ */
+static void tileset_orient_transforms(const struct tileset *tileset, uint8_t *oriented)
+{
+    uint32_t grid[9];
+    uint32_t target[9];
+    uint32_t other[9];
+
+    for (uint8_t t = 0; t < 8; ++t)
+    {
+        for (uint32_t i = 0; i < 9; ++i)
+        {
+            grid[i] = i;
+        }
+
+        tileset_transform_grid(t, grid, target);
+        tileset_orient_grid(tileset, target);
+
+        oriented[t] = t;
+
+        for (uint8_t o = 0; o < 8; ++o)
+        {
+            for (uint32_t i = 0; i < 9; ++i)
+            {
+                grid[i] = i;
+            }
+
+            tileset_orient_grid(tileset, grid);
+            tileset_transform_grid(o, grid, other);
+
+            if (!memcmp(target, other, sizeof target))
+            {
+                oriented[t] = o;
+                break;
+            }
+        }
+    }
+}
+
+static void tileset_tile_view(const struct tileset *tileset, uint32_t index, struct tileset_view *view)
+{
+    uint32_t tiles_per_row = tileset->image.width / tileset->tile_width;
+    uint32_t stride = tileset->image.width * sizeof(uint32_t);
+
+    view->data = tileset->image.data +
+        ((index / tiles_per_row) * tileset->tile_height * stride) +
+        ((index % tiles_per_row) * tileset->tile_width * sizeof(uint32_t));
+    view->stride = stride;
+    view->width = tileset->tile_width;
+    view->height = tileset->tile_height;
+}
+
+/* rotations only keep the shape of square tiles */
+static uint8_t tileset_nr_transforms(const struct tileset *tileset)
+{
+    if (tileset->deduplicate != TILESET_DEDUPLICATE_SYMMETRIC)
+    {
+        return 1;
+    }
+
+    return tileset->tile_width == tileset->tile_height ? 8 : 4;
+}
+
+int tileset_hash_begin(struct tileset *tileset)
+{
+    uint32_t nr_tiles =
+        (tileset->image.width / tileset->tile_width) *
+        (tileset->image.height / tileset->tile_height);
+
+    tileset->tile_hashes = memory_realloc_array(NULL, nr_tiles, sizeof(uint64_t));
+    if (tileset->tile_hashes == NULL)
+    {
+        return -1;
+    }
 
     return 0;
 }
+
+/* hashes one row of tiles, rows are independent so they can run in parallel */
+bool tileset_hash_band(struct tileset *tileset, uint32_t band)
+{
+    uint32_t tiles_per_row = tileset->image.width / tileset->tile_width;
+    uint8_t nr_transforms = tileset_nr_transforms(tileset);
+    uint32_t *scratch = NULL;
+
+    if (nr_transforms > 1)
+    {
+        scratch = memory_arena_alloc(tileset->tile_width * tileset->tile_height * sizeof(uint32_t));
+        if (scratch == NULL)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = band * tiles_per_row; i < (band + 1) * tiles_per_row; ++i)
+    {
+        struct tileset_view view;
+        uint64_t hash;
+
+        tileset_tile_view(tileset, i, &view);
+
+        /* equivalent tiles share the smallest hash of their variants */
+        hash = tileset_hash_tile(&view);
+        for (uint8_t t = 1; t < nr_transforms; ++t)
+        {
+            uint64_t variant = tileset_hash_variant(&view, t, scratch);
+
+            if (variant < hash)
+            {
+                hash = variant;
+            }
+        }
+
+        tileset->tile_hashes[i] = hash;
+    }
+
+    memory_arena_free(scratch);
+
+    return true;
+}
+
+/* merges tiles with matching hashed pixels, keeping the first of each */
+int tileset_deduplicate(struct tileset *tileset)
+{
+    uint32_t nr_tiles =
+        (tileset->image.width / tileset->tile_width) *
+        (tileset->image.height / tileset->tile_height);
+    bool symmetric = tileset->deduplicate == TILESET_DEDUPLICATE_SYMMETRIC;
+    uint8_t nr_transforms = tileset_nr_transforms(tileset);
+    const uint64_t *hashes = tileset->tile_hashes;
+    uint8_t oriented[8];
+    uint32_t nr_unique = 0;
+    uint32_t nr_transformed = 0;
+    uint32_t *buckets = NULL;
+    uint32_t *map = NULL;
+    uint32_t nr_buckets = 1;
+
+    if (symmetric)
+    {
+        tileset_orient_transforms(tileset, oriented);
+    }
+
+    while (nr_buckets < nr_tiles * 2)
+    {
+        nr_buckets <<= 1;
+    }
+
+    buckets = memory_realloc_array(NULL, nr_buckets, sizeof(uint32_t));
+    map = memory_realloc_array(NULL, nr_tiles, sizeof(uint32_t));
+    tileset->tile_sources = memory_realloc_array(NULL, nr_tiles, sizeof(uint32_t));
+    if (buckets == NULL || map == NULL || tileset->tile_sources == NULL)
+    {
+        goto error;
+    }
+
+    if (symmetric)
+    {
+        tileset->tile_transforms = memory_alloc(nr_tiles);
+        if (tileset->tile_transforms == NULL)
+        {
+            goto error;
+        }
+    }
+
+    /* bucket values are unique tile indices plus one */
+    memset(buckets, 0, nr_buckets * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < nr_tiles; ++i)
+    {
+        uint64_t hash = hashes[i];
+        uint32_t bucket = (uint32_t)(hash ^ (hash >> 32)) & (nr_buckets - 1);
+        struct tileset_view view;
+
+        tileset_tile_view(tileset, i, &view);
+
+        for (;;)
+        {
+            uint32_t unique = buckets[bucket];
+
+            if (unique == 0)
+            {
+                buckets[bucket] = nr_unique + 1;
+                tileset->tile_sources[nr_unique] = i;
+                map[i] = nr_unique;
+                if (symmetric)
+                {
+                    tileset->tile_transforms[i] = 0;
+                }
+                nr_unique++;
+                break;
+            }
+
+            unique--;
+
+            if (hashes[tileset->tile_sources[unique]] == hash)
+            {
+                struct tileset_view other;
+                uint8_t t;
+
+                tileset_tile_view(tileset, tileset->tile_sources[unique], &other);
+
+                for (t = 0; t < nr_transforms; ++t)
+                {
+                    if (tileset_same_tile(&other, t, &view))
+                    {
+                        break;
+                    }
+                }
+
+                if (t < nr_transforms)
+                {
+                    map[i] = unique;
+                    if (symmetric)
+                    {
+                        tileset->tile_transforms[i] = oriented[t];
+                        nr_transformed += t != 0;
+                    }
+                    break;
+                }
+            }
+
+            bucket = (bucket + 1) & (nr_buckets - 1);
+        }
+    }
+
+    if (nr_unique > 65536)
+    {
+        LOG_ERROR("Tileset \'%s\' has too many unique tiles (%u).\n",
+            tileset->image.path,
+            nr_unique);
+        goto error;
+    }
+
+    tileset->tile_map_entry_size = nr_unique <= 256 ? 1 : 2;
+    tileset->tile_map_size = nr_tiles * tileset->tile_map_entry_size;
+    tileset->nr_tile_map_entries = nr_tiles;
+    tileset->tile_map_width = tileset->image.width / tileset->tile_width;
+    tileset->tile_map_height = tileset->image.height / tileset->tile_height;
+    tileset->tile_map = memory_alloc(tileset->tile_map_size);
+    if (tileset->tile_map == NULL)
+    {
+        goto error;
+    }
+
+    for (uint32_t i = 0; i < nr_tiles; ++i)
+    {
+        if (tileset->tile_map_entry_size == 1)
+        {
+            tileset->tile_map[i] = map[i];
+        }
+        else
+        {
+            tileset->tile_map[i * 2 + 0] = map[i] & 0xff;
+            tileset->tile_map[i * 2 + 1] = (map[i] >> 8) & 0xff;
+        }
+    }
+
+    if (tileset_alloc_tiles(tileset, nr_unique))
+    {
+        goto error;
+    }
+
+    LOG_INFO(" - Merged %u duplicate tiles in \'%s\'\n",
+        nr_tiles - nr_unique,
+        tileset->image.path);
+
+    if (symmetric)
+    {
+        LOG_DEBUG("%u tiles are flipped or rotated copies.\n", nr_transformed);
+    }
+
+    free(buckets);
+    free(map);
+    free(tileset->tile_hashes);
+    tileset->tile_hashes = NULL;
+
+    return 0;
+
+error:
+    free(buckets);
+    free(map);
+    free(tileset->tile_hashes);
+    tileset->tile_hashes = NULL;
+    free(tileset->tile_sources);
+    tileset->tile_sources = NULL;
+    free(tileset->tile_map);
+    tileset->tile_map = NULL;
+    free(tileset->tile_transforms);
+    tileset->tile_transforms = NULL;
+    return -1;
+}
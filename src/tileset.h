@@ -33,6 +33,7 @@
 
 #include "image.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -40,10 +41,29 @@
 extern "C" {
 #endif
 
+#define TILESET_TILE_FLIP_X 1
+#define TILESET_TILE_FLIP_Y 2
+#define TILESET_TILE_ROTATE_90 4
+
+typedef enum
+{
+    TILESET_DEDUPLICATE_NONE,
+    TILESET_DEDUPLICATE_EXACT,
+    TILESET_DEDUPLICATE_SYMMETRIC,
+} tileset_deduplicate_t;
+
 struct tileset_tile
 {
     uint8_t *data;
     uint32_t data_size;
+    compress_mode_t compression;
+    uint32_t decompress_delta;
+
+    /* kept for the report */
+    uint32_t converted_size;
+    uint32_t uncompressed_size;
+    double quantize_time;
+    struct compress_stats compress_stats;
 };
 
 struct tileset
@@ -61,17 +81,56 @@ struct tileset
     bool rlet;
     bool gfx;
     bool compressed;
+    bool stored;
     bool bad_alpha;
     uint32_t tile_rotate;
     bool tile_flip_x;
     bool tile_flip_y;
+    tileset_deduplicate_t deduplicate;
+    bool quantize_once;
+    bool tilemap;
+
+    /* set once the whole image is quantized */
+    bool indexed;
+
+    /* set when duplicate tiles are merged */
+    uint64_t *tile_hashes;
+    uint32_t *tile_sources;
+    uint8_t *tile_transforms;
+    uint8_t *tile_map;
+    uint32_t tile_map_size;
+    uint32_t tile_map_entry_size;
+    uint32_t nr_tile_map_entries;
+    uint32_t tile_map_width;
+    uint32_t tile_map_height;
 
     /* set by output */
     uint32_t appvar_index;
+
+    /* bands of tile rows still hashing or converting */
+    atomic_uint nr_pending_hash_bands;
+    atomic_bool hash_error;
+    atomic_uint nr_pending_bands;
+
+    /* set when streaming outputs */
+    bool converted;
+    uint32_t nr_pending_outputs;
 };
 
 int tileset_alloc_tiles(struct tileset *tileset, uint32_t nr_tiles);
 
+compress_mode_t tileset_compression(const struct tileset *tileset);
+
+bool tileset_decompress_delta(const struct tileset *tileset, uint32_t *delta);
+
+int tileset_hash_begin(struct tileset *tileset);
+
+bool tileset_hash_band(struct tileset *tileset, uint32_t band);
+
+int tileset_deduplicate(struct tileset *tileset);
+
+void tileset_release_tiles(struct tileset *tileset);
+
 void tileset_free_tiles(struct tileset *tileset);
 
 #ifdef __cplusplus